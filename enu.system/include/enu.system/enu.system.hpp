@@ -10,6 +10,7 @@
 #include <enulib/privileged.hpp>
 #include <enulib/singleton.hpp>
 #include <enu.system/exchange_state.hpp>
+#include <enu.token/enu.token.hpp>
 
 #include <string>
 #include <type_traits>
@@ -120,12 +121,36 @@ namespace enumivosystem {
       ENULIB_SERIALIZE( enumivo_global_state3, (last_vpay_state_update)(total_vpay_share_change_rate) )
    };
 
+   enum schedule_order_type : uint8_t {
+      order_by_name     = 0, ///< elected producers take turns in name order
+      order_by_location = 1  ///< elected producers take turns in location order, ties broken by name
+   };
+
+   struct [[enumivo::table("global4"), enumivo::contract("enu.system")]] enumivo_global_state4 {
+      enumivo_global_state4() { }
+      uint32_t          bucket_fill_interval = 0; ///< seconds between reward bucket fills done by onblock, 0 fills them in claimrewards
+      uint8_t           schedule_order = 0;       ///< order of the elected producers in the schedule, see schedule_order_type
+      uint16_t          max_producers = 21;       ///< number of producers elected into the schedule
+      uint32_t          schedule_refresh_slots = 120; ///< block slots between producer schedule updates
+      bool              proxy_index_complete = false; ///< every delegator is listed in the proxyvoters table of its proxy
+      uint32_t          active_proxy_recounts = 0;    ///< number of rows in the proxyrecount table
+      bool              ram_fee_transfer = false;     ///< RAM trades pay principal and fee with one enu.token feetransfer
+      name              cleanprods_next;              ///< lower_bound for the next cleanprods page, empty after the last one
+      int64_t           unissued_savings  = 0;        ///< inflation filled into the buckets but not issued yet, see fill_buckets
+      int64_t           unissued_perblock = 0;
+      int64_t           unissued_pervote  = 0;
+
+      ENULIB_SERIALIZE( enumivo_global_state4, (bucket_fill_interval)(schedule_order)(max_producers)(schedule_refresh_slots)
+                        (proxy_index_complete)(active_proxy_recounts)(ram_fee_transfer)(cleanprods_next)
+                        (unissued_savings)(unissued_perblock)(unissued_pervote) )
+   };
+
    struct [[enumivo::table, enumivo::contract("enu.system")]] producer_info {
       name                  owner;
       double                total_votes = 0;
       enumivo::public_key     producer_key; /// a packed public key object
       bool                  is_active = true;
-      std::string           url;
+      std::string           url;  /// empty for producers registered since the url moved to producer_meta
       uint32_t              unpaid_blocks = 0;
       time_point            last_claim_time;
       uint16_t              location = 0;
@@ -151,6 +176,34 @@ namespace enumivosystem {
       ENULIB_SERIALIZE( producer_info2, (owner)(votepay_share)(last_votepay_share_update) )
    };
 
+   /**
+    * Registration data of a producer that votes, onblock and claimrewards never need. Kept apart
+    * from producer_info so that they read and rewrite a compact producer row.
+    */
+   struct [[enumivo::table, enumivo::contract("enu.system")]] producer_meta {
+      name            owner;
+      std::string     url;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      ENULIB_SERIALIZE( producer_meta, (owner)(url) )
+   };
+
+   /**
+    * Blocks produced since the last claim. Kept apart from producer_info so that onblock only
+    * rewrites this small row instead of the whole producer row on every block.
+    */
+   struct [[enumivo::table, enumivo::contract("enu.system")]] producer_blocks {
+      name            owner;
+      uint32_t        unpaid_blocks = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      ENULIB_SERIALIZE( producer_blocks, (owner)(unpaid_blocks) )
+   };
+
    struct [[enumivo::table, enumivo::contract("enu.system")]] voter_info {
       name                owner;     /// the voter
       name                proxy;     /// the proxy set by the voter, if any
@@ -188,17 +241,73 @@ namespace enumivosystem {
       ENULIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3) )
    };
 
+   /**
+    * Membership row of a voter that delegates to a proxy, scoped by the proxy, so that the
+    * delegators of a proxy can be listed without scanning the voters table.
+    */
+   struct [[enumivo::table, enumivo::contract("enu.system")]] proxy_voter {
+      name            owner;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      ENULIB_SERIALIZE( proxy_voter, (owner) )
+   };
+
+   /**
+    * Progress of a recalcproxy run: the vote weight of the delegators up to and including
+    * last_voter, which recalcproxy has already counted.
+    */
+   struct [[enumivo::table, enumivo::contract("enu.system")]] proxy_recount {
+      name            proxy;
+      name            last_voter;
+      double          counted_weight = 0;
+
+      uint64_t primary_key()const { return proxy.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      ENULIB_SERIALIZE( proxy_recount, (proxy)(last_voter)(counted_weight) )
+   };
+
+   /**
+    * One receiver of a bulkdelegate action.
+    */
+   struct delegation {
+      name      receiver;
+      asset     stake_net_quantity;
+      asset     stake_cpu_quantity;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      ENULIB_SERIALIZE( delegation, (receiver)(stake_net_quantity)(stake_cpu_quantity) )
+   };
+
+   /**
+    * One receiver of a bulkbuyram action.
+    */
+   struct ram_purchase {
+      name      receiver;
+      uint32_t  bytes = 0;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      ENULIB_SERIALIZE( ram_purchase, (receiver)(bytes) )
+   };
+
    typedef enumivo::multi_index< "voters"_n, voter_info >  voters_table;
+   typedef enumivo::multi_index< "proxyvoters"_n, proxy_voter > proxy_voters_table;
+   typedef enumivo::multi_index< "proxyrecount"_n, proxy_recount > proxy_recount_table;
 
 
    typedef enumivo::multi_index< "producers"_n, producer_info,
                                indexed_by<"prototalvote"_n, const_mem_fun<producer_info, double, &producer_info::by_votes>  >
                              > producers_table;
    typedef enumivo::multi_index< "producers2"_n, producer_info2 > producers_table2;
+   typedef enumivo::multi_index< "prodblocks"_n, producer_blocks > producer_blocks_table;
+   typedef enumivo::multi_index< "prodmeta"_n, producer_meta > producer_meta_table;
 
    typedef enumivo::singleton< "global"_n, enumivo_global_state >   global_state_singleton;
    typedef enumivo::singleton< "global2"_n, enumivo_global_state2 > global_state2_singleton;
    typedef enumivo::singleton< "global3"_n, enumivo_global_state3 > global_state3_singleton;
+   typedef enumivo::singleton< "global4"_n, enumivo_global_state4 > global_state4_singleton;
 
    //   static constexpr uint32_t     max_inflation_rate = 5;  // 5% annual inflation
    static constexpr uint32_t     seconds_per_day = 24 * 3600;
@@ -208,13 +317,23 @@ namespace enumivosystem {
          voters_table            _voters;
          producers_table         _producers;
          producers_table2        _producers2;
+         producer_blocks_table   _prodblocks;
          global_state_singleton  _global;
          global_state2_singleton _global2;
          global_state3_singleton _global3;
+         global_state4_singleton _global4;
          enumivo_global_state      _gstate;
          enumivo_global_state2     _gstate2;
          enumivo_global_state3     _gstate3;
+         enumivo_global_state4     _gstate4;
          rammarket               _rammarket;
+         enumivo::token::reader  _token_reader; ///< enu.token rows read by this action
+
+         /// global state as loaded, used to skip writing back singletons the action did not change
+         std::vector<char>       _gstate_loaded;
+         std::vector<char>       _gstate2_loaded;
+         std::vector<char>       _gstate3_loaded;
+         std::vector<char>       _gstate4_loaded;
 
       public:
          static constexpr enumivo::name active_permission{"active"_n};
@@ -232,10 +351,13 @@ namespace enumivosystem {
          system_contract( name s, name code, datastream<const char*> ds );
          ~system_contract();
 
+         /// the core symbol is read from rammarket once per action and shared with core_symbol()
          static symbol get_core_symbol( name system_account = "enumivo"_n ) {
-            rammarket rm(system_account, system_account.value);
-            const static auto sym = get_core_symbol( rm );
-            return sym;
+            if( !_core_symbol ) {
+               rammarket rm(system_account, system_account.value);
+               _core_symbol = get_core_symbol( rm );
+            }
+            return *_core_symbol;
          }
 
          // Actions:
@@ -267,6 +389,14 @@ namespace enumivosystem {
          void delegatebw( name from, name receiver,
                           asset stake_net_quantity, asset stake_cpu_quantity, bool transfer );
 
+         /**
+          *  Stakes ENU from the balance of 'from' for the benefit of every receiver listed in 'delegations'.
+          *  Each entry behaves like a delegatebw without the transfer flag, but 'from' makes a single token
+          *  transfer to enu.stake for the total and its vote weight is updated only once.
+          */
+         [[enumivo::action]]
+         void bulkdelegate( name from, const std::vector<delegation>& delegations );
+
 
          /**
           *  Decreases the total tokens delegated by from to receiver and/or
@@ -299,6 +429,21 @@ namespace enumivosystem {
          [[enumivo::action]]
          void buyrambytes( name payer, name receiver, uint32_t bytes );
 
+         /**
+          * Buys the requested number of bytes for every receiver in 'purchases' with a single
+          * market conversion and a single payment from payer.
+          */
+         [[enumivo::action]]
+         void bulkbuyram( name payer, const std::vector<ram_purchase>& purchases );
+
+         /**
+          *  Buys bytes of RAM for receiver and stakes for its benefit in one action, as buyrambytes
+          *  followed by delegatebw would. Meant to follow the newaccount action that created receiver.
+          */
+         [[enumivo::action]]
+         void onboard( name payer, name receiver, uint32_t bytes,
+                       asset stake_net_quantity, asset stake_cpu_quantity, bool transfer );
+
          /**
           *  Reduces quota my bytes and then performs an inline transfer of tokens
           *  to receiver based upon the average purchase price of the original quota.
@@ -321,17 +466,91 @@ namespace enumivosystem {
          [[enumivo::action]]
          void unregprod( const name producer );
 
+         /**
+          *  Examines up to limit producers starting at lower_bound and erases the long-inactive ones without
+          *  votes, so that they no longer slow down the producer schedule scan. Anyone may call it. Where the
+          *  next page starts is stored in global4 as cleanprods_next.
+          */
+         [[enumivo::action]]
+         void cleanprods( const name lower_bound, uint16_t limit );
+
          [[enumivo::action]]
          void setram( uint64_t max_ram_size );
          [[enumivo::action]]
          void setramrate( uint16_t bytes_per_block );
 
+         /**
+          *  Sets how often, in seconds, onblock fills the per-block and per-vote buckets. onblock only does the
+          *  accounting, the tokens are issued by issuefills, or by a claimrewards that pays out of them first.
+          *  With 0 the buckets are filled by each claimrewards instead.
+          */
+         [[enumivo::action]]
+         void setfillintvl( uint32_t interval );
+
+         /**
+          *  Selects the order in which elected producers take turns, one of schedule_order_type.
+          *  Ordering by location lets producers configure location so that consecutive producers are close.
+          */
+         [[enumivo::action]]
+         void setprodorder( uint8_t order );
+
+         /**
+          *  Sets the number of elected producers and how many block slots pass between producer schedule updates.
+          */
+         [[enumivo::action]]
+         void setschedcfg( uint16_t max_producers, uint32_t refresh_slots );
+
+         /**
+          *  Switches RAM trades between a transfer plus a fee transfer and a single enu.token feetransfer.
+          *  The deployed enu.token has to support feetransfer before this is enabled, and watchers of
+          *  transfer actions no longer see RAM payments as transfers once it is.
+          */
+         [[enumivo::action]]
+         void setramfeetr( bool enabled );
+
          [[enumivo::action]]
          void voteproducer( const name voter, const name proxy, const std::vector<name>& producers );
 
+         /**
+          *  Recomputes the vote weight of voter from its current stake and applies only the difference
+          *  to the producers or proxy it already votes for, without resending the producer list.
+          */
+         [[enumivo::action]]
+         void refreshvote( const name voter );
+
+         /**
+          *  Same as refreshvote for every listed voter. Anyone may call it, voters that have not
+          *  voted are skipped.
+          */
+         [[enumivo::action]]
+         void refreshvotes( const std::vector<name>& voters );
+
          [[enumivo::action]]
          void regproxy( const name proxy, bool isproxy );
 
+         /**
+          *  Adds the listed voters that use a proxy to the proxyvoters table of their proxy, for
+          *  votes cast before that table existed. Anyone may call it, payer pays for the added rows.
+          */
+         [[enumivo::action]]
+         void indexvoters( const name payer, const std::vector<name>& voters );
+
+         /**
+          *  Marks the indexvoters backfill as complete, which enables recalcproxy.
+          */
+         [[enumivo::action]]
+         void setproxyidx( bool complete );
+
+         /**
+          *  Recomputes proxied_vote_weight of proxy from the current stake of its delegators,
+          *  up to limit delegators per call. The last call applies the result. Only the proxy may
+          *  call it, and a limit of 0 drops a recount in progress.
+          *
+          *  @pre every delegator of proxy is listed in its proxyvoters table, see setproxyidx
+          */
+         [[enumivo::action]]
+         void recalcproxy( const name proxy, uint16_t limit );
+
          [[enumivo::action]]
          void setparams( const enumivo::blockchain_parameters& params );
 
@@ -339,6 +558,13 @@ namespace enumivosystem {
          [[enumivo::action]]
          void claimrewards( const name owner );
 
+         /**
+          *  Issues the inflation onblock has filled into the buckets since the last issue. Anyone may call
+          *  it, so that claimrewards usually only pays out the producer's share.
+          */
+         [[enumivo::action]]
+         void issuefills();
+
          [[enumivo::action]]
          void setpriv( name account, uint8_t is_priv );
 
@@ -357,6 +583,8 @@ namespace enumivosystem {
       private:
          // Implementation details:
 
+         static inline std::optional<symbol> _core_symbol;
+
          static symbol get_core_symbol( const rammarket& rm ) {
             auto itr = rm.find(ramcore_symbol.raw());
             enumivo_assert(itr != rm.end(), "system contract must first be initialized");
@@ -370,18 +598,35 @@ namespace enumivosystem {
 
          symbol core_symbol()const;
 
+         int64_t pending_ram_supply()const;
+         int64_t accrue_ram_supply();
          void update_ram_supply();
 
          //defined in delegate_bandwidth.cpp
+         int64_t purchase_ram( const name payer, const asset& quant );
+         void credit_ram( const name receiver, int64_t bytes );
          void changebw( name from, name receiver,
                         asset stake_net_quantity, asset stake_cpu_quantity, bool transfer );
+         void update_stake_delegated( const name from, const name receiver,
+                                      const asset& stake_net_delta, const asset& stake_cpu_delta );
+         void update_user_resources( const name from, const name receiver,
+                                     const asset& stake_net_delta, const asset& stake_cpu_delta,
+                                     voters_table::const_iterator receiver_voter );
+         void update_voting_power( const name voter, const asset& total_update,
+                                   voters_table::const_iterator voter_itr );
+
+         //defined in producer_pay.cpp
+         void fill_buckets( time_point ct );
+         void issue_bucket_fills();
 
          //defined in voting.hpp
          void update_elected_producers( block_timestamp timestamp );
          void update_votes( const name voter, const name proxy, const std::vector<name>& producers, bool voting );
 
          // defined in voting.cpp
-         void propagate_weight_change( const voter_info& voter );
+         void propagate_weight_change( const voter_info& voter, double proxied_delta = 0 );
+         void track_proxied_change( const name proxy, const name voter, double delta );
+         void drop_proxy_recount( const name proxy );
 
          double update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
                                                time_point ct,
@@ -0,0 +1,74 @@
+/**
+ *  @file
+ *  @copyright defined in enumivo/LICENSE
+ */
+#pragma once
+
+#include <cstdint>
+
+/**
+ *  Classification of account names by their raw 64 bit value. The first 12 characters are
+ *  stored in 5 bit groups from the most significant bit down, the 13th character in the lowest
+ *  4 bits, and a dot or a missing character is a zero group. Each check works on all groups at
+ *  once with mask arithmetic instead of a loop over the characters.
+ *
+ *  Only depends on the standard library so that the tests can check it on the host.
+ */
+namespace enumivosystem {
+
+   namespace name_utils_detail {
+      /// lowest bit of each of the 12 character groups, once the 13th character is shifted out
+      constexpr uint64_t group_low_bits  = 0x0084210842108421ull;
+      constexpr uint64_t group_high_bits = group_low_bits << 4;
+
+      /// true if any 5 bit group of groups is zero, subtracting one only borrows into the high bit of a group that was zero
+      constexpr bool has_zero_group( uint64_t groups ) {
+         return ( (groups - group_low_bits) & ~groups & group_high_bits ) != 0;
+      }
+   }
+
+   /**
+    *  True if one of the first 12 characters is a dot, which includes every name shorter than 12 characters.
+    */
+   constexpr bool has_dot( uint64_t value ) {
+      return name_utils_detail::has_zero_group( value >> 4 );
+   }
+
+   /**
+    *  Number of characters up to and including the last one that is not a dot.
+    */
+   constexpr uint32_t name_length( uint64_t value ) {
+      if( value & 0xFull ) {
+         return 13;
+      }
+      const uint64_t groups = value >> 4;
+      if( groups == 0 ) {
+         return 0;
+      }
+      return 12 - static_cast<uint32_t>( __builtin_ctzll( groups ) / 5 );
+   }
+
+   /**
+    *  True if a dot is followed by another character, so that the name is not its own suffix.
+    */
+   constexpr bool has_inner_dot( uint64_t value ) {
+      uint64_t groups = value >> 4;
+      if( (value & 0xFull) == 0 ) {
+         if( groups == 0 ) {
+            return false;
+         }
+         // the trailing dots are not followed by a character, fill them so they are not counted
+         groups |= ( 1ull << ( 5 * (__builtin_ctzll( groups ) / 5) ) ) - 1;
+      }
+      return name_utils_detail::has_zero_group( groups );
+   }
+
+   /**
+    *  True for names that can only be created by winning a name auction: names of 1 to 11
+    *  characters without a dot.
+    */
+   constexpr bool is_premium_name( uint64_t value ) {
+      return value != 0 && (value & 0x1FFull) == 0 && !has_inner_dot( value );
+   }
+
+} /// namespace enumivosystem
@@ -89,6 +89,7 @@ namespace enumivosystem {
 
       auto itr = _rammarket.find(ramcore_symbol.raw());
       auto tmp = *itr;
+      tmp.base.balance.amount += pending_ram_supply();
       auto enuout = tmp.convert( asset(bytes, ram_symbol), core_symbol() );
 
       buyram( payer, receiver, enuout );
@@ -106,15 +107,60 @@ namespace enumivosystem {
    void system_contract::buyram( name payer, name receiver, asset quant )
    {
       require_auth( payer );
-      update_ram_supply();
-
-      enumivo_assert( quant.symbol == core_symbol(), "must buy ram with core token" );
-      enumivo_assert( quant.amount > 0, "must purchase a positive amount" );
 
       /////////////////////////////////////////////////////////////////////////////////////
       //enumivo.prods is not allowed to get ram
       //enumivo_assert( receiver != "enumivo.prods"_n, "enumivo.prods prohibited to recieve ram" );
 
+      credit_ram( receiver, purchase_ram( payer, quant ) );
+   }
+
+   /**
+    *  Buys RAM for several receivers at once. The total number of bytes is priced against the
+    *  market once, the payer makes a single payment, and the bytes bought are
+    *  distributed proportionally to the requested amounts. Rounding leftovers go to the last receiver.
+    */
+   void system_contract::bulkbuyram( name payer, const std::vector<ram_purchase>& purchases )
+   {
+      require_auth( payer );
+      enumivo_assert( purchases.size() > 0, "no ram purchases specified" );
+
+      int64_t total_bytes = 0;
+      for( const auto& p : purchases ) {
+         enumivo_assert( p.bytes > 0, "must purchase a positive amount" );
+         total_bytes += p.bytes;
+      }
+
+      auto itr = _rammarket.find(ramcore_symbol.raw());
+      auto tmp = *itr;
+      tmp.base.balance.amount += pending_ram_supply();
+      auto enuout = tmp.convert( asset(total_bytes, ram_symbol), core_symbol() );
+
+      const int64_t bytes_out = purchase_ram( payer, enuout );
+
+      int64_t distributed = 0;
+      for( size_t i = 0; i < purchases.size(); ++i ) {
+         int64_t share = bytes_out - distributed;
+         if( i + 1 < purchases.size() ) {
+            share = static_cast<int64_t>( (static_cast<uint128_t>(bytes_out) * purchases[i].bytes) / uint64_t(total_bytes) );
+         }
+         enumivo_assert( share > 0, "must reserve a positive amount" );
+         distributed += share;
+         credit_ram( purchases[i].receiver, share );
+      }
+   }
+
+   /**
+    *  Charges payer quant (plus the fee) and converts it to RAM through the market.
+    *  Returns the number of bytes bought, which the caller must credit to a receiver.
+    */
+   int64_t system_contract::purchase_ram( const name payer, const asset& quant )
+   {
+      const int64_t new_ram = accrue_ram_supply();
+
+      enumivo_assert( quant.symbol == core_symbol(), "must buy ram with core token" );
+      enumivo_assert( quant.amount > 0, "must purchase a positive amount" );
+
       auto fee = quant;
       fee.amount = ( fee.amount + 199 ) / 200; /// .5% fee (round up)
       // fee.amount cannot be 0 since that is only possible if quant.amount is 0 which is not allowed by the assert above.
@@ -125,22 +171,30 @@ namespace enumivosystem {
       // quant_after_fee.amount should be > 0 if quant.amount > 1.
       // If quant.amount == 1, then quant_after_fee.amount == 0 and the next inline transfer will fail causing the buyram action to fail.
 
-      INLINE_ACTION_SENDER(enumivo::token, transfer)(
-         token_account, { {payer, active_permission}, {ram_account, active_permission} },
-         { payer, ram_account, quant_after_fee, std::string("buy ram") }
-      );
-
-      if( fee.amount > 0 ) {
+      if( _gstate4.ram_fee_transfer ) {
+         // principal and fee move in a single token action
+         INLINE_ACTION_SENDER(enumivo::token, feetransfer)(
+            token_account, { {payer, active_permission}, {ram_account, active_permission} },
+            { payer, ram_account, quant_after_fee, ramfee_account, fee, std::string("buy ram") }
+         );
+      } else {
          INLINE_ACTION_SENDER(enumivo::token, transfer)(
-            token_account, { {payer, active_permission} },
-            { payer, ramfee_account, fee, std::string("ram fee") }
+            token_account, { {payer, active_permission}, {ram_account, active_permission} },
+            { payer, ram_account, quant_after_fee, std::string("buy ram") }
          );
+         if( fee.amount > 0 ) {
+            INLINE_ACTION_SENDER(enumivo::token, transfer)(
+               token_account, { {payer, active_permission} },
+               { payer, ramfee_account, fee, std::string("ram fee") }
+            );
+         }
       }
 
       int64_t bytes_out;
 
       const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
       _rammarket.modify( market, same_payer, [&]( auto& es ) {
+          es.base.balance.amount += new_ram;
           bytes_out = es.convert( quant_after_fee,  ram_symbol ).amount;
       });
 
@@ -149,6 +203,14 @@ namespace enumivosystem {
       _gstate.total_ram_bytes_reserved += uint64_t(bytes_out);
       _gstate.total_ram_stake          += quant_after_fee.amount;
 
+      return bytes_out;
+   }
+
+   /**
+    *  Adds bytes to the RAM quota of receiver, who pays for the storage of its resources row.
+    */
+   void system_contract::credit_ram( const name receiver, int64_t bytes )
+   {
       user_resources_table  userres( _self, receiver.value );
       auto res_itr = userres.find( receiver.value );
       if( res_itr ==  userres.end() ) {
@@ -156,11 +218,11 @@ namespace enumivosystem {
                res.owner = receiver;
                res.net_weight = asset( 0, core_symbol() );
                res.cpu_weight = asset( 0, core_symbol() );
-               res.ram_bytes = bytes_out;
+               res.ram_bytes = bytes;
             });
       } else {
          userres.modify( res_itr, receiver, [&]( auto& res ) {
-               res.ram_bytes += bytes_out;
+               res.ram_bytes += bytes;
             });
       }
 
@@ -180,7 +242,7 @@ namespace enumivosystem {
     */
    void system_contract::sellram( name account, int64_t bytes ) {
       require_auth( account );
-      update_ram_supply();
+      const int64_t new_ram = accrue_ram_supply();
 
       enumivo_assert( bytes > 0, "cannot sell negative byte" );
 
@@ -192,6 +254,7 @@ namespace enumivosystem {
       asset tokens_out;
       auto itr = _rammarket.find(ramcore_symbol.raw());
       _rammarket.modify( itr, same_payer, [&]( auto& es ) {
+          es.base.balance.amount += new_ram;
           /// the cast to int64_t of bytes is safe because we certify bytes is <= quota which is limited by prior purchases
           tokens_out = es.convert( asset(bytes, ram_symbol), core_symbol());
       });
@@ -215,18 +278,127 @@ namespace enumivosystem {
          set_resource_limits( res_itr->owner.value, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
       }
 
-      INLINE_ACTION_SENDER(enumivo::token, transfer)(
-         token_account, { {ram_account, active_permission}, {account, active_permission} },
-         { ram_account, account, asset(tokens_out), std::string("sell ram") }
-      );
-
-      auto fee = ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
+      auto fee = tokens_out;
+      fee.amount = ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
       // since tokens_out.amount was asserted to be at least 2 earlier, fee.amount < tokens_out.amount
-      if( fee > 0 ) {
+      if( _gstate4.ram_fee_transfer ) {
+         // the fee is split off by the token contract instead of being paid back by the seller
+         INLINE_ACTION_SENDER(enumivo::token, feetransfer)(
+            token_account, { {ram_account, active_permission}, {account, active_permission} },
+            { ram_account, account, tokens_out - fee, ramfee_account, fee, std::string("sell ram") }
+         );
+      } else {
          INLINE_ACTION_SENDER(enumivo::token, transfer)(
-            token_account, { {account, active_permission} },
-            { account, ramfee_account, asset(fee, core_symbol()), std::string("sell ram fee") }
+            token_account, { {ram_account, active_permission}, {account, active_permission} },
+            { ram_account, account, tokens_out, std::string("sell ram") }
          );
+         if( fee.amount > 0 ) {
+            INLINE_ACTION_SENDER(enumivo::token, transfer)(
+               token_account, { {account, active_permission} },
+               { account, ramfee_account, fee, std::string("sell ram fee") }
+            );
+         }
+      }
+   }
+
+   void system_contract::update_stake_delegated( const name from, const name receiver,
+                                                 const asset& stake_net_delta, const asset& stake_cpu_delta )
+   {
+      del_bandwidth_table     del_tbl( _self, from.value );
+      auto itr = del_tbl.find( receiver.value );
+      if( itr == del_tbl.end() ) {
+         itr = del_tbl.emplace( from, [&]( auto& dbo ){
+               dbo.from          = from;
+               dbo.to            = receiver;
+               dbo.net_weight    = stake_net_delta;
+               dbo.cpu_weight    = stake_cpu_delta;
+            });
+      }
+      else {
+         del_tbl.modify( itr, same_payer, [&]( auto& dbo ){
+               dbo.net_weight    += stake_net_delta;
+               dbo.cpu_weight    += stake_cpu_delta;
+            });
+      }
+      enumivo_assert( 0 <= itr->net_weight.amount, "insufficient staked net bandwidth" );
+      enumivo_assert( 0 <= itr->cpu_weight.amount, "insufficient staked cpu bandwidth" );
+      if ( itr->net_weight.amount == 0 && itr->cpu_weight.amount == 0 ) {
+         del_tbl.erase( itr );
+      }
+   }
+
+   void system_contract::update_user_resources( const name from, const name receiver,
+                                                const asset& stake_net_delta, const asset& stake_cpu_delta,
+                                                voters_table::const_iterator receiver_voter )
+   {
+      user_resources_table   totals_tbl( _self, receiver.value );
+      auto tot_itr = totals_tbl.find( receiver.value );
+      if( tot_itr ==  totals_tbl.end() ) {
+         tot_itr = totals_tbl.emplace( from, [&]( auto& tot ) {
+               tot.owner = receiver;
+               tot.net_weight    = stake_net_delta;
+               tot.cpu_weight    = stake_cpu_delta;
+            });
+      } else {
+         totals_tbl.modify( tot_itr, from == receiver ? from : same_payer, [&]( auto& tot ) {
+               tot.net_weight    += stake_net_delta;
+               tot.cpu_weight    += stake_cpu_delta;
+            });
+      }
+      enumivo_assert( 0 <= tot_itr->net_weight.amount, "insufficient staked total net bandwidth" );
+      enumivo_assert( 0 <= tot_itr->cpu_weight.amount, "insufficient staked total cpu bandwidth" );
+
+      {
+         bool ram_managed = false;
+         bool net_managed = false;
+         bool cpu_managed = false;
+
+         if( receiver_voter != _voters.end() ) {
+            ram_managed = has_field( receiver_voter->flags1, voter_info::flags1_fields::ram_managed );
+            net_managed = has_field( receiver_voter->flags1, voter_info::flags1_fields::net_managed );
+            cpu_managed = has_field( receiver_voter->flags1, voter_info::flags1_fields::cpu_managed );
+         }
+
+         if( !(net_managed && cpu_managed) ) {
+            int64_t ram_bytes, net, cpu;
+            get_resource_limits( receiver.value, &ram_bytes, &net, &cpu );
+
+            set_resource_limits( receiver.value,
+                                 ram_managed ? ram_bytes : std::max( tot_itr->ram_bytes + ram_gift_bytes, ram_bytes ),
+                                 net_managed ? net : tot_itr->net_weight.amount,
+                                 cpu_managed ? cpu : tot_itr->cpu_weight.amount );
+         }
+      }
+
+      if ( tot_itr->net_weight.amount == 0 && tot_itr->cpu_weight.amount == 0  && tot_itr->ram_bytes == 0 ) {
+         totals_tbl.erase( tot_itr );
+      }
+   }
+
+   void system_contract::update_voting_power( const name voter, const asset& total_update,
+                                              voters_table::const_iterator voter_itr )
+   {
+      if( voter_itr == _voters.end() ) {
+         voter_itr = _voters.emplace( voter, [&]( auto& v ) {
+               v.owner  = voter;
+               v.staked = total_update.amount;
+            });
+      } else {
+         _voters.modify( voter_itr, same_payer, [&]( auto& v ) {
+               v.staked += total_update.amount;
+            });
+      }
+      enumivo_assert( 0 <= voter_itr->staked, "stake for voting cannot be negative");
+
+      if( voter_itr->producers.size() || voter_itr->proxy ) {
+         if( voter_itr->last_vote_weight > 0 ) {
+            // the vote is unchanged, only its weight moves, so the producer list does not have
+            // to be merged against itself as update_votes would
+            propagate_weight_change( *voter_itr );
+         } else {
+            // first weight cast by this voter, stake has to be activated
+            update_votes( voter, voter_itr->proxy, voter_itr->producers, false );
+         }
       }
    }
 
@@ -244,77 +416,16 @@ namespace enumivosystem {
          from = receiver;
       }
 
+      // Look up the voter rows of both parties once. When staking to self (or with transfer) they are
+      // the same row, which is then shared by the resource-limit and the voting power updates below.
+      const auto from_voter     = _voters.find( from.value );
+      const auto receiver_voter = ( receiver == from ) ? from_voter : _voters.find( receiver.value );
+
       // update stake delegated from "from" to "receiver"
-      {
-         del_bandwidth_table     del_tbl( _self, from.value );
-         auto itr = del_tbl.find( receiver.value );
-         if( itr == del_tbl.end() ) {
-            itr = del_tbl.emplace( from, [&]( auto& dbo ){
-                  dbo.from          = from;
-                  dbo.to            = receiver;
-                  dbo.net_weight    = stake_net_delta;
-                  dbo.cpu_weight    = stake_cpu_delta;
-               });
-         }
-         else {
-            del_tbl.modify( itr, same_payer, [&]( auto& dbo ){
-                  dbo.net_weight    += stake_net_delta;
-                  dbo.cpu_weight    += stake_cpu_delta;
-               });
-         }
-         enumivo_assert( 0 <= itr->net_weight.amount, "insufficient staked net bandwidth" );
-         enumivo_assert( 0 <= itr->cpu_weight.amount, "insufficient staked cpu bandwidth" );
-         if ( itr->net_weight.amount == 0 && itr->cpu_weight.amount == 0 ) {
-            del_tbl.erase( itr );
-         }
-      } // itr can be invalid, should go out of scope
+      update_stake_delegated( from, receiver, stake_net_delta, stake_cpu_delta );
 
       // update totals of "receiver"
-      {
-         user_resources_table   totals_tbl( _self, receiver.value );
-         auto tot_itr = totals_tbl.find( receiver.value );
-         if( tot_itr ==  totals_tbl.end() ) {
-            tot_itr = totals_tbl.emplace( from, [&]( auto& tot ) {
-                  tot.owner = receiver;
-                  tot.net_weight    = stake_net_delta;
-                  tot.cpu_weight    = stake_cpu_delta;
-               });
-         } else {
-            totals_tbl.modify( tot_itr, from == receiver ? from : same_payer, [&]( auto& tot ) {
-                  tot.net_weight    += stake_net_delta;
-                  tot.cpu_weight    += stake_cpu_delta;
-               });
-         }
-         enumivo_assert( 0 <= tot_itr->net_weight.amount, "insufficient staked total net bandwidth" );
-         enumivo_assert( 0 <= tot_itr->cpu_weight.amount, "insufficient staked total cpu bandwidth" );
-
-         {
-            bool ram_managed = false;
-            bool net_managed = false;
-            bool cpu_managed = false;
-
-            auto voter_itr = _voters.find( receiver.value );
-            if( voter_itr != _voters.end() ) {
-               ram_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed );
-               net_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::net_managed );
-               cpu_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::cpu_managed );
-            }
-
-            if( !(net_managed && cpu_managed) ) {
-               int64_t ram_bytes, net, cpu;
-               get_resource_limits( receiver.value, &ram_bytes, &net, &cpu );
-
-               set_resource_limits( receiver.value,
-                                    ram_managed ? ram_bytes : std::max( tot_itr->ram_bytes + ram_gift_bytes, ram_bytes ),
-                                    net_managed ? net : tot_itr->net_weight.amount,
-                                    cpu_managed ? cpu : tot_itr->cpu_weight.amount );
-            }
-         }
-
-         if ( tot_itr->net_weight.amount == 0 && tot_itr->cpu_weight.amount == 0  && tot_itr->ram_bytes == 0 ) {
-            totals_tbl.erase( tot_itr );
-         }
-      } // tot_itr can be invalid, should go out of scope
+      update_user_resources( from, receiver, stake_net_delta, stake_cpu_delta, receiver_voter );
 
       // create refund or update from existing refund
       if ( stake_account != source_stake_from ) { //for enumivo both transfer and refund make no sense
@@ -407,25 +518,7 @@ namespace enumivosystem {
       }
 
       // update voting power
-      {
-         asset total_update = stake_net_delta + stake_cpu_delta;
-         auto from_voter = _voters.find( from.value );
-         if( from_voter == _voters.end() ) {
-            from_voter = _voters.emplace( from, [&]( auto& v ) {
-                  v.owner  = from;
-                  v.staked = total_update.amount;
-               });
-         } else {
-            _voters.modify( from_voter, same_payer, [&]( auto& v ) {
-                  v.staked += total_update.amount;
-               });
-         }
-         enumivo_assert( 0 <= from_voter->staked, "stake for voting cannot be negative");
-
-         if( from_voter->producers.size() || from_voter->proxy ) {
-            update_votes( from, from_voter->proxy, from_voter->producers, false );
-         }
-      }
+      update_voting_power( from, stake_net_delta + stake_cpu_delta, from_voter );
    }
 
    void system_contract::delegatebw( name from, name receiver,
@@ -441,6 +534,43 @@ namespace enumivosystem {
       changebw( from, receiver, stake_net_quantity, stake_cpu_quantity, transfer);
    } // delegatebw
 
+   void system_contract::onboard( name payer, name receiver, uint32_t bytes,
+                                  asset stake_net_quantity, asset stake_cpu_quantity, bool transfer )
+   {
+      /// buyrambytes and delegatebw both require_auth( payer ) before changing any state
+      buyrambytes( payer, receiver, bytes );
+      delegatebw( payer, receiver, stake_net_quantity, stake_cpu_quantity, transfer );
+   } // onboard
+
+   void system_contract::bulkdelegate( name from, const std::vector<delegation>& delegations )
+   {
+      require_auth( from );
+      enumivo_assert( delegations.size() > 0, "no delegations specified" );
+
+      const asset zero_asset( 0, core_symbol() );
+      asset total_stake = zero_asset;
+      for( const auto& d : delegations ) {
+         enumivo_assert( d.receiver != from, "use delegatebw to stake to self" );
+         enumivo_assert( d.stake_cpu_quantity >= zero_asset, "must stake a positive amount" );
+         enumivo_assert( d.stake_net_quantity >= zero_asset, "must stake a positive amount" );
+         enumivo_assert( d.stake_net_quantity.amount + d.stake_cpu_quantity.amount > 0, "must stake a positive amount" );
+
+         update_stake_delegated( from, d.receiver, d.stake_net_quantity, d.stake_cpu_quantity );
+         update_user_resources( from, d.receiver, d.stake_net_quantity, d.stake_cpu_quantity, _voters.find( d.receiver.value ) );
+
+         total_stake += d.stake_net_quantity + d.stake_cpu_quantity;
+      }
+
+      if ( stake_account != from ) {
+         INLINE_ACTION_SENDER(enumivo::token, transfer)(
+            token_account, { {from, active_permission} },
+            { from, stake_account, total_stake, std::string("stake bandwidth") }
+         );
+      }
+
+      update_voting_power( from, total_stake, _voters.find( from.value ) );
+   } // bulkdelegate
+
    void system_contract::undelegatebw( name from, name receiver,
                                        asset unstake_net_quantity, asset unstake_cpu_quantity )
    {
@@ -1,4 +1,5 @@
 #include <enu.system/enu.system.hpp>
+#include <enu.system/name_utils.hpp>
 #include <enulib/dispatcher.hpp>
 #include <enulib/crypto.h>
 
@@ -15,16 +16,42 @@ namespace enumivosystem {
     _voters(_self, _self.value),
     _producers(_self, _self.value),
     _producers2(_self, _self.value),
+    _prodblocks(_self, _self.value),
     _global(_self, _self.value),
     _global2(_self, _self.value),
     _global3(_self, _self.value),
-    _rammarket(_self, _self.value)
+    _global4(_self, _self.value),
+    _rammarket(_self, _self.value),
+    _token_reader(token_account)
    {
 
       //print( "construct system\n" );
-      _gstate  = _global.exists() ? _global.get() : get_default_parameters();
-      _gstate2 = _global2.exists() ? _global2.get() : enumivo_global_state2{};
-      _gstate3 = _global3.exists() ? _global3.get() : enumivo_global_state3{};
+      /// the packed snapshot stays empty when the singleton does not exist yet, so it is always written
+      if( _global.exists() ) {
+         _gstate        = _global.get();
+         _gstate_loaded = enumivo::pack( _gstate );
+      } else {
+         _gstate = get_default_parameters();
+      }
+      if( _global2.exists() ) {
+         _gstate2        = _global2.get();
+         _gstate2_loaded = enumivo::pack( _gstate2 );
+      }
+      if( _global3.exists() ) {
+         _gstate3        = _global3.get();
+         _gstate3_loaded = enumivo::pack( _gstate3 );
+      }
+      if( _global4.exists() ) {
+         _gstate4        = _global4.get();
+         _gstate4_loaded = enumivo::pack( _gstate4 );
+      }
+   }
+
+   template<typename Singleton, typename State>
+   static void set_if_changed( Singleton& singleton, const State& state, const std::vector<char>& loaded, name payer ) {
+      if( loaded.empty() || enumivo::pack( state ) != loaded ) {
+         singleton.set( state, payer );
+      }
    }
 
    enumivo_global_state system_contract::get_default_parameters() {
@@ -44,14 +71,17 @@ namespace enumivosystem {
    }
 
    symbol system_contract::core_symbol()const {
-      const static auto sym = get_core_symbol( _rammarket );
-      return sym;
+      if( !_core_symbol ) {
+         _core_symbol = get_core_symbol( _rammarket );
+      }
+      return *_core_symbol;
    }
 
    system_contract::~system_contract() {
-      _global.set( _gstate, _self );
-      _global2.set( _gstate2, _self );
-      _global3.set( _gstate3, _self );
+      set_if_changed( _global,  _gstate,  _gstate_loaded,  _self );
+      set_if_changed( _global2, _gstate2, _gstate2_loaded, _self );
+      set_if_changed( _global3, _gstate3, _gstate3_loaded, _self );
+      set_if_changed( _global4, _gstate4, _gstate4_loaded, _self );
    }
 
    void system_contract::setram( uint64_t max_ram_size ) {
@@ -74,14 +104,41 @@ namespace enumivosystem {
       _gstate.max_ram_size = max_ram_size;
    }
 
-   void system_contract::update_ram_supply() {
+   /**
+    *  RAM supply growth since the last update, derived on read from the elapsed blocks and the current rate.
+    */
+   int64_t system_contract::pending_ram_supply()const {
       auto cbt = current_block_time();
 
-      if( cbt <= _gstate2.last_ram_increase ) return;
+      if( cbt <= _gstate2.last_ram_increase ) return 0;
 
-      auto itr = _rammarket.find(ramcore_symbol.raw());
-      auto new_ram = (cbt.slot - _gstate2.last_ram_increase.slot)*_gstate2.new_ram_per_block;
+      return int64_t(cbt.slot - _gstate2.last_ram_increase.slot) * _gstate2.new_ram_per_block;
+   }
+
+   /**
+    *  Adds the pending RAM supply growth to max_ram_size and returns it. The caller is responsible for
+    *  adding the returned bytes to the base balance of the RAM market, which lets buyram and sellram fold
+    *  it into the market modification they make anyway.
+    */
+   int64_t system_contract::accrue_ram_supply() {
+      auto cbt = current_block_time();
+
+      if( cbt <= _gstate2.last_ram_increase ) return 0;
+
+      auto new_ram = pending_ram_supply();
       _gstate.max_ram_size += new_ram;
+      _gstate2.last_ram_increase = cbt;
+
+      return new_ram;
+   }
+
+   void system_contract::update_ram_supply() {
+      auto new_ram = accrue_ram_supply();
+
+      /// with new_ram_per_block == 0 the market does not need to be touched at all
+      if( new_ram == 0 ) return;
+
+      auto itr = _rammarket.find(ramcore_symbol.raw());
 
       /**
        *  Increase the amount of ram for sale based upon the change in max ram size.
@@ -89,7 +146,6 @@ namespace enumivosystem {
       _rammarket.modify( itr, same_payer, [&]( auto& m ) {
          m.base.balance.amount += new_ram;
       });
-      _gstate2.last_ram_increase = cbt;
    }
 
    /**
@@ -106,6 +162,43 @@ namespace enumivosystem {
       _gstate2.new_ram_per_block = bytes_per_block;
    }
 
+   void system_contract::setfillintvl( uint32_t interval ) {
+      require_auth( _self );
+
+      enumivo_assert( interval <= seconds_per_day, "bucket fill interval should be at most one day" );
+      _gstate4.bucket_fill_interval = interval;
+   }
+
+   void system_contract::setprodorder( uint8_t order ) {
+      require_auth( _self );
+
+      enumivo_assert( order == order_by_name || order == order_by_location, "unknown schedule order" );
+      _gstate4.schedule_order = order;
+   }
+
+   void system_contract::setschedcfg( uint16_t max_producers, uint32_t refresh_slots ) {
+      require_auth( _self );
+
+      enumivo_assert( 0 < max_producers && max_producers <= 125, "max_producers must be between 1 and 125" );
+      enumivo_assert( 0 < refresh_slots && refresh_slots <= blocks_per_day, "refresh_slots must be between 1 and one day" );
+      _gstate4.max_producers          = max_producers;
+      _gstate4.schedule_refresh_slots = refresh_slots;
+   }
+
+   void system_contract::setramfeetr( bool enabled ) {
+      require_auth( _self );
+
+      enumivo_assert( enabled != _gstate4.ram_fee_transfer, "action has no effect" );
+      _gstate4.ram_fee_transfer = enabled;
+   }
+
+   void system_contract::setproxyidx( bool complete ) {
+      require_auth( _self );
+
+      enumivo_assert( complete != _gstate4.proxy_index_complete, "action has no effect" );
+      _gstate4.proxy_index_complete = complete;
+   }
+
    void system_contract::setparams( const enumivo::blockchain_parameters& params ) {
       require_auth( _self );
       (enumivo::blockchain_parameters&)(_gstate) = params;
@@ -289,11 +382,11 @@ namespace enumivosystem {
 
    void system_contract::bidname( name bidder, name newname, asset bid ) {
       require_auth( bidder );
-      enumivo_assert( newname.suffix() == newname, "you can only bid on top-level suffix" );
+      enumivo_assert( !has_inner_dot( newname.value ), "you can only bid on top-level suffix" );
 
       enumivo_assert( (bool)newname, "the empty name is not a valid account name to bid on" );
-      enumivo_assert( (newname.value & 0xFull) == 0, "13 character names are not valid account names to bid on" );
-      enumivo_assert( (newname.value & 0x1F0ull) == 0, "accounts with 12 character names and no dots can be created without bidding required" );
+      enumivo_assert( name_length( newname.value ) < 13, "13 character names are not valid account names to bid on" );
+      enumivo_assert( name_length( newname.value ) < 12, "accounts with 12 character names and no dots can be created without bidding required" );
       enumivo_assert( !is_account( newname ), "account already exists" );
       enumivo_assert( bid.symbol == core_symbol(), "asset must be system token" );
       enumivo_assert( bid.amount > 0, "insufficient bid" );
@@ -376,16 +469,8 @@ namespace enumivosystem {
                             ignore<authority> active ) {
 
       if( creator != _self ) {
-         uint64_t tmp = newact.value >> 4;
-         bool has_dot = false;
-
-         for( uint32_t i = 0; i < 12; ++i ) {
-           has_dot |= !(tmp & 0x1f);
-           tmp >>= 5;
-         }
-         if( has_dot ) { // or is less than 12 characters
-            auto suffix = newact.suffix();
-            if( suffix == newact ) {
+         if( has_dot( newact.value ) ) { // or is less than 12 characters
+            if( is_premium_name( newact.value ) ) {
                name_bid_table bids(_self, _self.value);
                auto current = bids.find( newact.value );
                enumivo_assert( current != bids.end(), "no active bid for name" );
@@ -393,17 +478,18 @@ namespace enumivosystem {
                enumivo_assert( current->high_bid < 0, "auction for name is not closed yet" );
                bids.erase( current );
             } else {
-               enumivo_assert( creator == suffix, "only suffix may create this account" );
+               enumivo_assert( creator == newact.suffix(), "only suffix may create this account" );
             }
          }
       }
 
       user_resources_table  userres( _self, newact.value);
+      const auto core = system_contract::get_core_symbol();
 
       userres.emplace( newact, [&]( auto& res ) {
         res.owner = newact;
-        res.net_weight = asset( 0, system_contract::get_core_symbol() );
-        res.cpu_weight = asset( 0, system_contract::get_core_symbol() );
+        res.net_weight = asset( 0, core );
+        res.cpu_weight = asset( 0, core );
       });
 
       set_resource_limits( newact.value, 0, 0, 0 );
@@ -431,7 +517,7 @@ namespace enumivosystem {
       auto itr = _rammarket.find(ramcore_symbol.raw());
       enumivo_assert( itr == _rammarket.end(), "system contract has already been initialized" );
 
-      auto system_token_supply   = enumivo::token::get_supply(token_account, core.code() );
+      auto system_token_supply   = _token_reader.get_supply( core.code() );
       enumivo_assert( system_token_supply.symbol == core, "specified core symbol does not exist (precision mismatch)" );
 
       enumivo_assert( system_token_supply.amount > 0, "system token supply must be greater than 0" );
@@ -444,19 +530,57 @@ namespace enumivosystem {
          m.quote.balance.symbol = core;
       });
    }
+
+   /**
+    *  Before the chain is activated onblock only records the block time in global2. This does it
+    *  without constructing system_contract, which would load and write back every global singleton.
+    *  Returns false when the full onblock has to run instead.
+    */
+   static bool onblock_before_activation( name self ) {
+      global_state_singleton global( self, self.value );
+      if( !global.exists() || global.get().total_activated_stake >= min_activated_stake )
+         return false;
+
+      global_state2_singleton global2( self, self.value );
+      if( !global2.exists() )
+         return false;
+
+      enumivo::require_auth( self );
+
+      /// the block timestamp is the first field of the block header
+      block_timestamp timestamp;
+      read_action_data( &timestamp.slot, sizeof(timestamp.slot) );
+
+      auto gstate2 = global2.get();
+      gstate2.last_block_num = timestamp;
+      global2.set( gstate2, self );
+      return true;
+   }
+
 } /// enu.system
 
 
-ENUMIVO_DISPATCH( enumivosystem::system_contract,
-     // native.hpp (newaccount definition is actually in enu.system.cpp)
-     (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)
-     // enu.system.cpp
-     (init)(setram)(setramrate)(setparams)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
-     (rmvproducer)(updtrevision)(bidname)(bidrefund)
-     // delegate_bandwidth.cpp
-     (buyrambytes)(buyram)(sellram)(delegatebw)(undelegatebw)(refund)
-     // voting.cpp
-     (regproducer)(unregprod)(voteproducer)(regproxy)
-     // producer_pay.cpp
-     (onblock)(claimrewards)
-)
+extern "C" {
+   void apply( uint64_t receiver, uint64_t code, uint64_t action ) {
+      if( code == receiver ) {
+         if( action == "onblock"_n.value && enumivosystem::onblock_before_activation( enumivo::name(receiver) ) )
+            return;
+
+         switch( action ) {
+            ENUMIVO_DISPATCH_HELPER( enumivosystem::system_contract,
+               // native.hpp (newaccount definition is actually in enu.system.cpp)
+               (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)
+               // enu.system.cpp
+               (init)(setram)(setramrate)(setfillintvl)(setprodorder)(setschedcfg)(setramfeetr)(setproxyidx)(setparams)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
+               (rmvproducer)(updtrevision)(bidname)(bidrefund)
+               // delegate_bandwidth.cpp
+               (buyrambytes)(buyram)(bulkbuyram)(sellram)(delegatebw)(bulkdelegate)(onboard)(undelegatebw)(refund)
+               // voting.cpp
+               (regproducer)(unregprod)(cleanprods)(voteproducer)(refreshvote)(refreshvotes)(regproxy)(indexvoters)(recalcproxy)
+               // producer_pay.cpp
+               (onblock)(claimrewards)(issuefills)
+            )
+         }
+      }
+   }
+}
@@ -40,20 +40,35 @@ namespace enumivosystem {
 
       /**
        * At startup the initial producer may not be one that is registered / elected
-       * and therefore there may be no producer object for them.
+       * and therefore there may be no producer object for them. The producer row is only
+       * looked up the first time a producer needs a block counter.
        */
-      auto prod = _producers.find( producer.value );
-      if ( prod != _producers.end() ) {
+      auto counter = _prodblocks.find( producer.value );
+      if ( counter != _prodblocks.end() ) {
          _gstate.total_unpaid_blocks++;
-         _producers.modify( prod, same_payer, [&](auto& p ) {
-               p.unpaid_blocks++;
+         _prodblocks.modify( counter, same_payer, [&](auto& c ) {
+               c.unpaid_blocks++;
+         });
+      } else if ( _producers.find( producer.value ) != _producers.end() ) {
+         _gstate.total_unpaid_blocks++;
+         _prodblocks.emplace( _self, [&](auto& c ) {
+               c.owner         = producer;
+               c.unpaid_blocks = 1;
          });
       }
 
-      /// only update block producers once every minute, block_timestamp is in half seconds
-      if( timestamp.slot - _gstate.last_producer_schedule_update.slot > 120 ) {
+      /// only update block producers once every schedule_refresh_slots (a minute by default), block_timestamp is in half seconds
+      if( timestamp.slot - _gstate.last_producer_schedule_update.slot > _gstate4.schedule_refresh_slots ) {
          update_elected_producers( timestamp );
 
+         /// in amortized mode the reward buckets are filled here and the tokens are issued by the next claimrewards
+         if( _gstate4.bucket_fill_interval > 0 ) {
+            const auto ct = current_time_point();
+            if( ct - _gstate.last_pervote_bucket_fill >= microseconds(int64_t(_gstate4.bucket_fill_interval) * 1000000) ) {
+               fill_buckets( ct );
+            }
+         }
+
          if( (timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day ) {
             name_bid_table bids(_self, _self.value);
             auto idx = bids.get_index<"highbid"_n>();
@@ -74,53 +89,99 @@ namespace enumivosystem {
    }
 
    using namespace enumivo;
-   void system_contract::claimrewards( const name owner ) {
-      require_auth( owner );
-
-      const auto& prod = _producers.get( owner.value );
-      enumivo_assert( prod.active(), "producer does not have an active key" );
-
-      enumivo_assert( _gstate.total_activated_stake >= min_activated_stake,
-                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
-
-      const auto ct = current_time_point();
-
-      enumivo_assert( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
-
-      const asset token_supply   = enumivo::token::get_supply(token_account, core_symbol().code() );
+   /**
+    *  Accounts the inflation accrued since the last fill to savings and the per-block and per-vote
+    *  buckets. Only global state is written, the tokens are issued by issue_bucket_fills, so that
+    *  onblock can fill the buckets without sending inline actions that could fail.
+    */
+   void system_contract::fill_buckets( time_point ct ) {
+      const asset token_supply   = _token_reader.get_supply( core_symbol().code() );
       const auto usecs_since_last_fill = (ct - _gstate.last_pervote_bucket_fill).count();
 
       if( usecs_since_last_fill > 0 && _gstate.last_pervote_bucket_fill > time_point() ) {
-         auto new_tokens = static_cast<int64_t>( (continuous_rate * double(token_supply.amount) * double(usecs_since_last_fill)) / double(useconds_per_year) );
+         /// inflation that is accounted but not issued yet still compounds
+         const int64_t supply = token_supply.amount + _gstate4.unissued_savings + _gstate4.unissued_perblock + _gstate4.unissued_pervote;
+         auto new_tokens = static_cast<int64_t>( (continuous_rate * double(supply) * double(usecs_since_last_fill)) / double(useconds_per_year) );
 
          auto to_producers     = new_tokens / 5;
          auto to_savings       = new_tokens - to_producers;
          auto to_per_block_pay = to_producers / 4;
          auto to_per_vote_pay  = to_producers - to_per_block_pay;
 
-         INLINE_ACTION_SENDER(enumivo::token, issue)(
-            token_account, { {_self, active_permission} },
-            { _self, asset(new_tokens, core_symbol()), std::string("issue tokens for producer pay and savings") }
-         );
+         _gstate4.unissued_savings  += to_savings;
+         _gstate4.unissued_perblock += to_per_block_pay;
+         _gstate4.unissued_pervote  += to_per_vote_pay;
+
+         _gstate.pervote_bucket          += to_per_vote_pay;
+         _gstate.perblock_bucket         += to_per_block_pay;
+         _gstate.last_pervote_bucket_fill = ct;
+      }
+   }
+
+   /**
+    *  Issues the inflation accounted by fill_buckets and moves it to savings and the bucket accounts.
+    *  A part that rounded down to zero is skipped, the token contract rejects empty transfers.
+    */
+   void system_contract::issue_bucket_fills() {
+      const int64_t new_tokens = _gstate4.unissued_savings + _gstate4.unissued_perblock + _gstate4.unissued_pervote;
+      if( new_tokens == 0 ) {
+         return;
+      }
+
+      INLINE_ACTION_SENDER(enumivo::token, issue)(
+         token_account, { {_self, active_permission} },
+         { _self, asset(new_tokens, core_symbol()), std::string("issue tokens for producer pay and savings") }
+      );
 
+      if( _gstate4.unissued_savings > 0 ) {
          INLINE_ACTION_SENDER(enumivo::token, transfer)(
             token_account, { {_self, active_permission} },
-            { _self, saving_account, asset(to_savings, core_symbol()), "unallocated inflation" }
+            { _self, saving_account, asset(_gstate4.unissued_savings, core_symbol()), "unallocated inflation" }
          );
+      }
 
+      if( _gstate4.unissued_perblock > 0 ) {
          INLINE_ACTION_SENDER(enumivo::token, transfer)(
             token_account, { {_self, active_permission} },
-            { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
+            { _self, bpay_account, asset(_gstate4.unissued_perblock, core_symbol()), "fund per-block bucket" }
          );
+      }
 
+      if( _gstate4.unissued_pervote > 0 ) {
          INLINE_ACTION_SENDER(enumivo::token, transfer)(
             token_account, { {_self, active_permission} },
-            { _self, vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" }
+            { _self, vpay_account, asset(_gstate4.unissued_pervote, core_symbol()), "fund per-vote bucket" }
          );
+      }
 
-         _gstate.pervote_bucket          += to_per_vote_pay;
-         _gstate.perblock_bucket         += to_per_block_pay;
-         _gstate.last_pervote_bucket_fill = ct;
+      _gstate4.unissued_savings  = 0;
+      _gstate4.unissued_perblock = 0;
+      _gstate4.unissued_pervote  = 0;
+   }
+
+   void system_contract::issuefills() {
+      enumivo_assert( _gstate4.unissued_savings + _gstate4.unissued_perblock + _gstate4.unissued_pervote > 0,
+                      "no bucket fills to issue" );
+
+      issue_bucket_fills();
+   }
+
+   void system_contract::claimrewards( const name owner ) {
+      require_auth( owner );
+
+      const auto& prod = _producers.get( owner.value );
+      enumivo_assert( prod.active(), "producer does not have an active key" );
+
+      enumivo_assert( _gstate.total_activated_stake >= min_activated_stake,
+                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
+
+      const auto ct = current_time_point();
+
+      enumivo_assert( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+
+      if( _gstate4.bucket_fill_interval == 0 ) {
+         fill_buckets( ct );
+         issue_bucket_fills();
       }
 
       auto prod2 = _producers2.find( owner.value );
@@ -145,9 +206,16 @@ namespace enumivosystem {
       // This is okay because in this case the producer will not get paid anything either way.
       // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
 
+      /// blocks counted before the prodblocks table existed are still in producer_info
+      uint32_t unpaid_blocks = prod.unpaid_blocks;
+      auto counter = _prodblocks.find( owner.value );
+      if( counter != _prodblocks.end() ) {
+         unpaid_blocks += counter->unpaid_blocks;
+      }
+
       int64_t producer_per_block_pay = 0;
       if( _gstate.total_unpaid_blocks > 0 ) {
-         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / _gstate.total_unpaid_blocks;
+         producer_per_block_pay = (_gstate.perblock_bucket * unpaid_blocks) / _gstate.total_unpaid_blocks;
       }
 
       double new_votepay_share = update_producer_votepay_share( prod2,
@@ -176,7 +244,7 @@ namespace enumivosystem {
 
       _gstate.pervote_bucket      -= producer_per_vote_pay;
       _gstate.perblock_bucket     -= producer_per_block_pay;
-      _gstate.total_unpaid_blocks -= prod.unpaid_blocks;
+      _gstate.total_unpaid_blocks -= unpaid_blocks;
 
       update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? prod.total_votes : 0.0) );
 
@@ -184,6 +252,17 @@ namespace enumivosystem {
          p.last_claim_time = ct;
          p.unpaid_blocks   = 0;
       });
+      if( counter != _prodblocks.end() && counter->unpaid_blocks > 0 ) {
+         _prodblocks.modify( counter, same_payer, [&](auto& c) {
+            c.unpaid_blocks = 0;
+         });
+      }
+
+      /// in amortized mode the fills onblock accounted are left to issuefills, unless this claim has
+      /// paid out of their part of a bucket that the bucket account does not hold yet
+      if( _gstate.perblock_bucket < _gstate4.unissued_perblock || _gstate.pervote_bucket < _gstate4.unissued_pervote ) {
+         issue_bucket_fills();
+      }
 
       if( producer_per_block_pay > 0 ) {
          INLINE_ACTION_SENDER(enumivo::token, transfer)(
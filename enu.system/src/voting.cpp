@@ -17,6 +17,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <tuple>
 
 namespace enumivosystem {
    using enumivo::indexed_by;
@@ -25,6 +26,12 @@ namespace enumivosystem {
    using enumivo::singleton;
    using enumivo::transaction;
 
+   /// applies delta to a vote tally, floating point arithmetics can give small negative numbers which are cut to zero
+   double add_vote_weight( double tally, double delta ) {
+      const double result = tally + delta;
+      return result < 0 ? 0.0 : result;
+   }
+
    /**
     *  This method will create a producer_config and producer_info object for 'producer'
     *
@@ -41,11 +48,24 @@ namespace enumivosystem {
       auto prod = _producers.find( producer.value );
       const auto ct = current_time_point();
 
+      producer_meta_table prodmeta( _self, _self.value );
+      auto meta = prodmeta.find( producer.value );
+      if ( meta == prodmeta.end() ) {
+         prodmeta.emplace( producer, [&]( producer_meta& m ){
+            m.owner = producer;
+            m.url   = url;
+         });
+      } else if ( meta->url != url ) {
+         prodmeta.modify( meta, producer, [&]( producer_meta& m ){
+            m.url = url;
+         });
+      }
+
       if ( prod != _producers.end() ) {
          _producers.modify( prod, producer, [&]( producer_info& info ){
             info.producer_key = producer_key;
             info.is_active    = true;
-            info.url          = url;
+            info.url.clear(); // registered before producer_meta
             info.location     = location;
             if ( info.last_claim_time == time_point() )
                info.last_claim_time = ct;
@@ -66,7 +86,6 @@ namespace enumivosystem {
             info.total_votes     = 0;
             info.producer_key    = producer_key;
             info.is_active       = true;
-            info.url             = url;
             info.location        = location;
             info.last_claim_time = ct;
          });
@@ -87,24 +106,89 @@ namespace enumivosystem {
       });
    }
 
+   /**
+    *  Examines up to `limit` producer rows, starting at `lower_bound`, and erases those of producers that are
+    *  unregistered, have no votes left, no unpaid blocks and have neither claimed nor registered in the last
+    *  30 days. Anyone may call it. A page without such producers succeeds as well, so that callers can page
+    *  through the whole table from cleanprods_next. Votes that still list an erased producer are dropped on
+    *  the next vote update.
+    */
+   void system_contract::cleanprods( const name lower_bound, uint16_t limit ) {
+      enumivo_assert( limit > 0, "limit must be positive" );
+
+      const auto ct = current_time_point();
+      const auto min_claim_time = ct - microseconds(30 * useconds_per_day);
+      double total_inactive_vpay_share = 0.0;
+      double delta_change_rate         = 0.0;
+      uint16_t removed = 0;
+      producer_meta_table prodmeta( _self, _self.value );
+
+      auto pitr = _producers.lower_bound( lower_bound.value );
+      for( uint16_t examined = 0; pitr != _producers.end() && examined < limit; ++examined ) {
+         auto blocks = _prodblocks.find( pitr->owner.value );
+         const bool has_unpaid_blocks = pitr->unpaid_blocks > 0 || ( blocks != _prodblocks.end() && blocks->unpaid_blocks > 0 );
+         if( pitr->active() || pitr->total_votes >= 1 || has_unpaid_blocks || min_claim_time < pitr->last_claim_time ) {
+            ++pitr;
+            continue;
+         }
+
+         auto prod2 = _producers2.find( pitr->owner.value );
+         if( prod2 != _producers2.end() ) {
+            /// a producer that has not been reset since it stopped claiming still accrues into the global share
+            const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
+            if( prod2->last_votepay_share_update < last_claim_plus_3days ) {
+               total_inactive_vpay_share += prod2->votepay_share + pitr->total_votes
+                                           * double( (ct - prod2->last_votepay_share_update).count() / 1E6 );
+               delta_change_rate -= pitr->total_votes;
+            }
+            _producers2.erase( prod2 );
+         }
+         if( blocks != _prodblocks.end() ) {
+            _prodblocks.erase( blocks );
+         }
+         auto meta = prodmeta.find( pitr->owner.value );
+         if( meta != prodmeta.end() ) {
+            prodmeta.erase( meta );
+         }
+
+         _gstate.total_producer_vote_weight = add_vote_weight( _gstate.total_producer_vote_weight, -pitr->total_votes );
+         pitr = _producers.erase( pitr );
+         ++removed;
+      }
+
+      _gstate4.cleanprods_next = ( pitr != _producers.end() ) ? pitr->owner : name();
+      if( removed > 0 ) {
+         update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
+      }
+   }
+
    void system_contract::update_elected_producers( block_timestamp block_time ) {
       _gstate.last_producer_schedule_update = block_time;
 
       auto idx = _producers.get_index<"prototalvote"_n>();
 
+      const uint16_t max_producers = _gstate4.max_producers;
       std::vector< std::pair<enumivo::producer_key,uint16_t> > top_producers;
-      top_producers.reserve(21);
+      top_producers.reserve(max_producers);
 
-      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
+      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < max_producers && 0 < it->total_votes && it->active(); ++it ) {
          top_producers.emplace_back( std::pair<enumivo::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
       }
 
-      if ( top_producers.size() < _gstate.last_producer_schedule_size ) {
+      /// never shrink the schedule, unless max_producers was lowered below its current size
+      if ( top_producers.size() < std::min( _gstate.last_producer_schedule_size, max_producers ) ) {
          return;
       }
 
-      /// sort by producer name
-      std::sort( top_producers.begin(), top_producers.end() );
+      if( _gstate4.schedule_order == order_by_location ) {
+         /// neighbours in the schedule are close to each other, the name keeps the order deterministic
+         std::sort( top_producers.begin(), top_producers.end(), []( const auto& a, const auto& b ) {
+            return std::tie( a.second, a.first.producer_name ) < std::tie( b.second, b.first.producer_name );
+         });
+      } else {
+         /// sort by producer name
+         std::sort( top_producers.begin(), top_producers.end() );
+      }
 
       std::vector<enumivo::producer_key> producers;
 
@@ -119,12 +203,25 @@ namespace enumivosystem {
       }
    }
 
+   /// drops producers erased by cleanprods from a sorted vote list, erased must be sorted as well
+   void remove_erased_producers( std::vector<name>& producers, const std::vector<name>& erased ) {
+      producers.erase( std::remove_if( producers.begin(), producers.end(), [&]( const name& p ) {
+                          return std::binary_search( erased.begin(), erased.end(), p );
+                       } ),
+                       producers.end() );
+   }
+
    double stake2vote( int64_t staked ) {
       /// TODO subtract 2080 brings the large numbers closer to this decade
       double weight = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
       return double(staked) * std::pow( 2, weight );
    }
 
+   /**
+    *  The total votepay share grows linearly at total_vpay_share_change_rate between checkpoints. The
+    *  checkpoint in global2/global3 is only moved when the rate or the total itself changes, otherwise the
+    *  current total is derived from the last checkpoint without writing anything.
+    */
    double system_contract::update_total_votepay_share( time_point ct,
                                                        double additional_shares_delta,
                                                        double shares_rate_delta )
@@ -135,6 +232,10 @@ namespace enumivosystem {
                                        * double( (ct - _gstate3.last_vpay_state_update).count() / 1E6 );
       }
 
+      if( additional_shares_delta == 0.0 && shares_rate_delta == 0.0 ) {
+         return _gstate2.total_producer_votepay_share + delta_total_votepay_share;
+      }
+
       delta_total_votepay_share += additional_shares_delta;
       if( delta_total_votepay_share < 0 && _gstate2.total_producer_votepay_share < -delta_total_votepay_share ) {
          _gstate2.total_producer_votepay_share = 0.0;
@@ -230,67 +331,84 @@ namespace enumivosystem {
          new_vote_weight += voter->proxied_vote_weight;
       }
 
-      boost::container::flat_map<name, pair<double, bool /*new*/> > producer_deltas;
+      static const std::vector<name> no_producers;
+      const std::vector<name>* old_producers = &no_producers;
+      double old_vote_weight = 0.0;
       if ( voter->last_vote_weight > 0 ) {
          if( voter->proxy ) {
             auto old_proxy = _voters.find( voter->proxy.value );
             enumivo_assert( old_proxy != _voters.end(), "old proxy not found" ); //data corruption
-            _voters.modify( old_proxy, same_payer, [&]( auto& vp ) {
-                  vp.proxied_vote_weight -= voter->last_vote_weight;
-               });
-            propagate_weight_change( *old_proxy );
+            track_proxied_change( voter->proxy, voter_name, -voter->last_vote_weight );
+            propagate_weight_change( *old_proxy, -voter->last_vote_weight );
          } else {
-            for( const auto& p : voter->producers ) {
-               auto& d = producer_deltas[p];
-               d.first -= voter->last_vote_weight;
-               d.second = false;
-            }
+            old_producers   = &voter->producers;
+            old_vote_weight = voter->last_vote_weight;
          }
       }
 
+      const std::vector<name>* new_producers = &no_producers;
       if( proxy ) {
          auto new_proxy = _voters.find( proxy.value );
          enumivo_assert( new_proxy != _voters.end(), "invalid proxy specified" ); //if ( !voting ) { data corruption } else { wrong vote }
          enumivo_assert( !voting || new_proxy->is_proxy, "proxy not found" );
          if ( new_vote_weight >= 0 ) {
-            _voters.modify( new_proxy, same_payer, [&]( auto& vp ) {
-                  vp.proxied_vote_weight += new_vote_weight;
-               });
-            propagate_weight_change( *new_proxy );
+            track_proxied_change( proxy, voter_name, new_vote_weight );
+            propagate_weight_change( *new_proxy, new_vote_weight );
          }
-      } else {
-         if( new_vote_weight >= 0 ) {
-            for( const auto& p : producers ) {
-               auto& d = producer_deltas[p];
-               d.first += new_vote_weight;
-               d.second = true;
-            }
+      } else if( new_vote_weight >= 0 ) {
+         new_producers = &producers;
+      }
+
+      /// both lists are sorted, so a single merge pass yields the per-producer deltas
+      struct producer_delta {
+         name   producer;
+         double delta;
+         bool   from_new_set;
+      };
+      std::vector<producer_delta> producer_deltas;
+      producer_deltas.reserve( old_producers->size() + new_producers->size() );
+      auto old_itr = old_producers->begin();
+      auto new_itr = new_producers->begin();
+      while( old_itr != old_producers->end() || new_itr != new_producers->end() ) {
+         if( new_itr == new_producers->end() || ( old_itr != old_producers->end() && *old_itr < *new_itr ) ) {
+            producer_deltas.push_back( { *old_itr++, -old_vote_weight, false } );
+         } else if( old_itr == old_producers->end() || *new_itr < *old_itr ) {
+            producer_deltas.push_back( { *new_itr++, new_vote_weight, true } );
+         } else {
+            producer_deltas.push_back( { *new_itr, new_vote_weight - old_vote_weight, true } );
+            ++old_itr;
+            ++new_itr;
          }
       }
 
       const auto ct = current_time_point();
       double delta_change_rate         = 0.0;
       double total_inactive_vpay_share = 0.0;
+      std::vector<name> erased_producers;
       for( const auto& pd : producer_deltas ) {
-         auto pitr = _producers.find( pd.first.value );
+         auto pitr = _producers.find( pd.producer.value );
          if( pitr != _producers.end() ) {
-            enumivo_assert( !voting || pitr->active() || !pd.second.second /* not from new set */, "producer is not currently registered" );
+            enumivo_assert( !voting || pitr->active() || !pd.from_new_set, "producer is not currently registered" );
             double init_total_votes = pitr->total_votes;
-            _producers.modify( pitr, same_payer, [&]( auto& p ) {
-               p.total_votes += pd.second.first;
-               if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
-                  p.total_votes = 0;
-               }
-               _gstate.total_producer_vote_weight += pd.second.first;
-               //enumivo_assert( p.total_votes >= 0, "something bad happened" );
-            });
-            auto prod2 = _producers2.find( pd.first.value );
+            if( pd.delta != 0.0 ) {
+               _producers.modify( pitr, same_payer, [&]( auto& p ) {
+                  p.total_votes = add_vote_weight( p.total_votes, pd.delta );
+                  _gstate.total_producer_vote_weight = add_vote_weight( _gstate.total_producer_vote_weight, pd.delta );
+               });
+            }
+            auto prod2 = _producers2.find( pd.producer.value );
             if( prod2 != _producers2.end() ) {
                const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
                bool crossed_threshold       = (last_claim_plus_3days <= ct);
                bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
                // Note: updated_after_threshold implies cross_threshold
 
+               /// an unchanged weight does not change the accrual rate, so the votepay share only needs
+               /// to be touched for the one-time reset of a producer that stopped claiming
+               if( pd.delta == 0.0 && !( crossed_threshold && !updated_after_threshold ) ) {
+                  continue;
+               }
+
                double new_votepay_share = update_producer_votepay_share( prod2,
                                              ct,
                                              updated_after_threshold ? 0.0 : init_total_votes,
@@ -298,26 +416,69 @@ namespace enumivosystem {
                                           );
 
                if( !crossed_threshold ) {
-                  delta_change_rate += pd.second.first;
+                  delta_change_rate += pd.delta;
                } else if( !updated_after_threshold ) {
                   total_inactive_vpay_share += new_votepay_share;
                   delta_change_rate -= init_total_votes;
                }
             }
          } else {
-            enumivo_assert( !pd.second.second /* not from new set */, "producer is not registered" ); //data corruption
+            /// a stored vote may still list producers erased by cleanprods, they are dropped from it
+            enumivo_assert( !voting || !pd.from_new_set, "producer is not registered" );
+            if( pd.from_new_set ) {
+               erased_producers.push_back( pd.producer );
+            }
          }
       }
 
       update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
 
+      if( voter->proxy != proxy ) {
+         if( voter->proxy ) {
+            proxy_voters_table old_delegators( _self, voter->proxy.value );
+            auto ditr = old_delegators.find( voter_name.value );
+            if( ditr != old_delegators.end() ) {
+               old_delegators.erase( ditr );
+            }
+         }
+         if( proxy ) {
+            proxy_voters_table new_delegators( _self, proxy.value );
+            new_delegators.emplace( voter_name, [&]( auto& d ) {
+               d.owner = voter_name;
+            });
+         }
+      }
+
       _voters.modify( voter, same_payer, [&]( auto& av ) {
          av.last_vote_weight = new_vote_weight;
          av.producers = producers;
          av.proxy     = proxy;
+         if( !erased_producers.empty() ) {
+            remove_erased_producers( av.producers, erased_producers );
+         }
       });
    }
 
+   void system_contract::refreshvote( const name voter ) {
+      require_auth( voter );
+
+      const auto& v = _voters.get( voter.value, "user must stake before they can vote" );
+      enumivo_assert( v.last_vote_weight > 0 && ( v.proxy || v.producers.size() > 0 ), "voter has not voted" );
+      propagate_weight_change( v );
+   }
+
+   void system_contract::refreshvotes( const std::vector<name>& voters ) {
+      enumivo_assert( voters.size() > 0, "no voters specified" );
+
+      for( const auto& voter : voters ) {
+         auto vitr = _voters.find( voter.value );
+         if( vitr == _voters.end() || vitr->last_vote_weight <= 0 || ( !vitr->proxy && vitr->producers.empty() ) ) {
+            continue;
+         }
+         propagate_weight_change( *vitr );
+      }
+   }
+
    /**
     *  An account marked as a proxy can vote with the weight of other accounts which
     *  have selected it as a proxy. Other accounts must refresh their voteproducer to
@@ -337,6 +498,9 @@ namespace enumivosystem {
          _voters.modify( pitr, same_payer, [&]( auto& p ) {
                p.is_proxy = isproxy;
             });
+         if( !isproxy ) {
+            drop_proxy_recount( proxy );
+         }
          propagate_weight_change( *pitr );
       } else {
          _voters.emplace( proxy, [&]( auto& p ) {
@@ -346,33 +510,151 @@ namespace enumivosystem {
       }
    }
 
-   void system_contract::propagate_weight_change( const voter_info& voter ) {
+   void system_contract::indexvoters( const name payer, const std::vector<name>& voters ) {
+      require_auth( payer );
+      enumivo_assert( voters.size() > 0, "no voters specified" );
+
+      for( const auto& voter : voters ) {
+         auto vitr = _voters.find( voter.value );
+         if( vitr == _voters.end() || !vitr->proxy ) {
+            continue;
+         }
+         proxy_voters_table delegators( _self, vitr->proxy.value );
+         if( delegators.find( voter.value ) == delegators.end() ) {
+            delegators.emplace( payer, [&]( auto& d ) {
+               d.owner = voter;
+            });
+         }
+      }
+   }
+
+   /**
+    *  The sum is collected in a proxyrecount row across calls. Delegators are counted in key order and
+    *  their last_vote_weight is set to their current weight, so that later changes of counted delegators
+    *  can be added to the sum by track_proxied_change while the recount is in progress.
+    *
+    *  Delegators missing from proxyvoters would silently be left out of the sum, so the recount is
+    *  refused until the backfill of votes cast before that table existed is marked complete.
+    */
+   void system_contract::recalcproxy( const name proxy, uint16_t limit ) {
+      require_auth( proxy );
+      enumivo_assert( _gstate4.proxy_index_complete, "proxy delegators are not fully indexed yet" );
+      const auto& proxy_row = _voters.get( proxy.value, "proxy not found" );
+
+      if( limit == 0 ) {
+         drop_proxy_recount( proxy );
+         return;
+      }
+
+      proxy_recount_table recounts( _self, _self.value );
+      auto recount = recounts.find( proxy.value );
+      if( recount == recounts.end() ) {
+         recount = recounts.emplace( proxy, [&]( auto& r ) {
+            r.proxy = proxy;
+         });
+         ++_gstate4.active_proxy_recounts;
+      }
+
+      proxy_voters_table delegators( _self, proxy.value );
+      name last_voter       = recount->last_voter;
+      double counted_weight = recount->counted_weight;
+      auto ditr = delegators.upper_bound( last_voter.value );
+      for( uint16_t examined = 0; ditr != delegators.end() && examined < limit; ++examined ) {
+         last_voter = ditr->owner;
+         auto vitr = _voters.find( ditr->owner.value );
+         if( vitr == _voters.end() || vitr->proxy != proxy ) {
+            ditr = delegators.erase( ditr ); // stale membership
+            continue;
+         }
+         if( vitr->last_vote_weight > 0 ) {
+            const double weight = stake2vote( vitr->staked );
+            if( weight != vitr->last_vote_weight ) {
+               _voters.modify( vitr, same_payer, [&]( auto& v ) {
+                  v.last_vote_weight = weight;
+               });
+            }
+            counted_weight += weight;
+         }
+         ++ditr;
+      }
+
+      if( ditr != delegators.end() ) {
+         recounts.modify( recount, same_payer, [&]( auto& r ) {
+            r.last_voter     = last_voter;
+            r.counted_weight = counted_weight;
+         });
+         return;
+      }
+
+      recounts.erase( recount );
+      --_gstate4.active_proxy_recounts;
+      propagate_weight_change( proxy_row, counted_weight - proxy_row.proxied_vote_weight );
+   }
+
+   void system_contract::drop_proxy_recount( const name proxy ) {
+      if( _gstate4.active_proxy_recounts == 0 ) {
+         return;
+      }
+      proxy_recount_table recounts( _self, _self.value );
+      auto recount = recounts.find( proxy.value );
+      if( recount != recounts.end() ) {
+         recounts.erase( recount );
+         --_gstate4.active_proxy_recounts;
+      }
+   }
+
+   /// proxied weight changes are frequent and recounts are rare, the counter spares the lookup in the common case
+   void system_contract::track_proxied_change( const name proxy, const name voter, double delta ) {
+      if( _gstate4.active_proxy_recounts == 0 ) {
+         return;
+      }
+      proxy_recount_table recounts( _self, _self.value );
+      auto recount = recounts.find( proxy.value );
+      if( recount != recounts.end() && voter <= recount->last_voter ) {
+         recounts.modify( recount, same_payer, [&]( auto& r ) {
+            r.counted_weight = add_vote_weight( r.counted_weight, delta );
+         });
+      }
+   }
+
+   /**
+    *  Recomputes the vote weight of voter and pushes the difference to its proxy or producers.
+    *
+    *  @param proxied_delta - change to voter.proxied_vote_weight that has not been written yet. It is
+    *  stored together with last_vote_weight so that every row on the proxy chain is modified only once.
+    */
+   void system_contract::propagate_weight_change( const voter_info& voter, double proxied_delta ) {
       enumivo_assert( !voter.proxy || !voter.is_proxy, "account registered as a proxy is not allowed to use a proxy" );
+      const double new_proxied_weight = add_vote_weight( voter.proxied_vote_weight, proxied_delta );
       double new_weight = stake2vote( voter.staked );
       if ( voter.is_proxy ) {
-         new_weight += voter.proxied_vote_weight;
+         new_weight += new_proxied_weight;
       }
 
-      /// don't propagate small changes (1 ~= epsilon)
+      /// don't propagate small changes (1 ~= epsilon). One unit of stake weighs far more than that, so this only
+      /// filters rounding noise. last_vote_weight is left untouched in that case, so the noise is not lost either.
       if ( fabs( new_weight - voter.last_vote_weight ) > 1 )  {
+         std::vector<name> erased_producers;
          if ( voter.proxy ) {
             auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
-            _voters.modify( proxy, same_payer, [&]( auto& p ) {
-                  p.proxied_vote_weight += new_weight - voter.last_vote_weight;
-               }
-            );
-            propagate_weight_change( proxy );
+            track_proxied_change( voter.proxy, voter.owner, new_weight - voter.last_vote_weight );
+            propagate_weight_change( proxy, new_weight - voter.last_vote_weight );
          } else {
             auto delta = new_weight - voter.last_vote_weight;
             const auto ct = current_time_point();
             double delta_change_rate         = 0;
             double total_inactive_vpay_share = 0;
             for ( auto acnt : voter.producers ) {
-               auto& prod = _producers.get( acnt.value, "producer not found" ); //data corruption
+               auto pitr = _producers.find( acnt.value );
+               if ( pitr == _producers.end() ) {
+                  erased_producers.push_back( acnt ); // erased by cleanprods
+                  continue;
+               }
+               const auto& prod = *pitr;
                const double init_total_votes = prod.total_votes;
                _producers.modify( prod, same_payer, [&]( auto& p ) {
-                  p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
+                  p.total_votes = add_vote_weight( p.total_votes, delta );
+                  _gstate.total_producer_vote_weight = add_vote_weight( _gstate.total_producer_vote_weight, delta );
                });
                auto prod2 = _producers2.find( acnt.value );
                if ( prod2 != _producers2.end() ) {
@@ -398,11 +680,21 @@ namespace enumivosystem {
 
             update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
          }
+
+         _voters.modify( voter, same_payer, [&]( auto& v ) {
+               v.last_vote_weight    = new_weight;
+               v.proxied_vote_weight = new_proxied_weight;
+               if ( !erased_producers.empty() ) {
+                  remove_erased_producers( v.producers, erased_producers );
+               }
+            }
+         );
+      } else if ( proxied_delta != 0 ) {
+         _voters.modify( voter, same_payer, [&]( auto& v ) {
+               v.proxied_vote_weight = new_proxied_weight;
+            }
+         );
       }
-      _voters.modify( voter, same_payer, [&]( auto& v ) {
-            v.last_vote_weight = new_weight;
-         }
-      );
    }
 
 } /// namespace enumivosystem
@@ -8,6 +8,8 @@
 #include <enulib/enu.hpp>
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace enumivosystem {
    class system_contract;
@@ -37,6 +39,21 @@ namespace enumivo {
                         asset   quantity,
                         string  memo );
 
+         /**
+          * Transfers `quantity` from `from` to `to` and `fee` from `from` to `fee_receiver`
+          * in a single action, so that callers paying a fee on every transfer do not need
+          * to dispatch a second transfer. from, to and, when fee is positive, fee_receiver are
+          * notified as by transfer, but under the feetransfer action name, which watchers of
+          * transfer have to handle too.
+          */
+         [[enumivo::action]]
+         void feetransfer( name    from,
+                           name    to,
+                           asset   quantity,
+                           name    fee_receiver,
+                           asset   fee,
+                           string  memo );
+
          [[enumivo::action]]
          void open( name owner, const symbol& symbol, name ram_payer );
 
@@ -57,6 +74,41 @@ namespace enumivo {
             return ac.balance;
          }
 
+         /**
+          * Reads supply and balances of one token contract, keeping every row it has read.
+          * Inline actions only run after the current action, so rows of another contract
+          * can not change while the reader is alive as long as it lives for one action only.
+          * Not for use inside the token contract itself, which changes these rows.
+          */
+         class reader {
+            public:
+               explicit reader( name token_contract_account )
+               :_token_contract(token_contract_account) {}
+
+               asset get_supply( symbol_code sym_code ) {
+                  for( const auto& s : _supplies ) {
+                     if( s.symbol.code() == sym_code ) return s;
+                  }
+                  stats statstable( _token_contract, sym_code.raw() );
+                  _supplies.push_back( statstable.get( sym_code.raw() ).supply );
+                  return _supplies.back();
+               }
+
+               asset get_balance( name owner, symbol_code sym_code ) {
+                  for( const auto& b : _balances ) {
+                     if( b.first == owner && b.second.symbol.code() == sym_code ) return b.second;
+                  }
+                  accounts accountstable( _token_contract, owner.value );
+                  _balances.emplace_back( owner, accountstable.get( sym_code.raw() ).balance );
+                  return _balances.back().second;
+               }
+
+            private:
+               name                                  _token_contract;
+               std::vector<asset>                    _supplies;
+               std::vector<std::pair<name, asset>>   _balances;
+         };
+
       private:
          struct [[enumivo::table]] account {
             asset    balance;
@@ -115,6 +115,42 @@ void token::transfer( name    from,
     add_balance( to, quantity, payer );
 }
 
+void token::feetransfer( name    from,
+                         name    to,
+                         asset   quantity,
+                         name    fee_receiver,
+                         asset   fee,
+                         string  memo )
+{
+    enumivo_assert( from != to, "cannot transfer to self" );
+    enumivo_assert( from != fee_receiver, "cannot pay fee to self" );
+    require_auth( from );
+    enumivo_assert( is_account( to ), "to account does not exist");
+    enumivo_assert( is_account( fee_receiver ), "fee receiver account does not exist");
+
+    auto sym = quantity.symbol.code();
+    stats statstable( _self, sym.raw() );
+    const auto& st = statstable.get( sym.raw() );
+
+    require_recipient( from );
+    require_recipient( to );
+
+    enumivo_assert( quantity.is_valid(), "invalid quantity" );
+    enumivo_assert( quantity.amount > 0, "must transfer positive quantity" );
+    enumivo_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+    enumivo_assert( fee.is_valid(), "invalid fee" );
+    enumivo_assert( fee.amount >= 0, "fee must not be negative" );
+    enumivo_assert( fee.symbol == quantity.symbol, "fee symbol precision mismatch" );
+    enumivo_assert( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    sub_balance( from, quantity + fee );
+    add_balance( to, quantity, has_auth( to ) ? to : from );
+    if( fee.amount > 0 ) {
+       require_recipient( fee_receiver );
+       add_balance( fee_receiver, fee, has_auth( fee_receiver ) ? fee_receiver : from );
+    }
+}
+
 void token::sub_balance( name owner, asset value ) {
    accounts from_acnts( _self, owner.value );
 
@@ -172,4 +208,4 @@ void token::close( name owner, const symbol& symbol )
 
 } /// namespace enumivo
 
-ENUMIVO_DISPATCH( enumivo::token, (create)(issue)(transfer)(open)(close)(retire) )
+ENUMIVO_DISPATCH( enumivo::token, (create)(issue)(transfer)(feetransfer)(open)(close)(retire) )
@@ -0,0 +1,212 @@
+#include <boost/test/unit_test.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "../enu.system_tester.hpp"
+
+using namespace enu_system;
+
+/**
+ * Per-action cost of the system contract under parameterized scenarios. Scenario sizes are set with
+ * `--name=value` arguments after `--`, for example
+ *
+ *    system_benchmark -- --voters=200 --producers=30 --delegators=50 --ram_trades=100 --output=bench.json
+ *
+ * The default sizes are only large enough to exercise every scenario once, for the ctest run.
+ *
+ * The billed CPU and NET of every measured action are written as JSON to --output. Without --output the
+ * JSON is printed to stdout between "--- begin json report ---" and "--- end json report ---" lines.
+ */
+namespace {
+
+   uint32_t benchmark_param( const std::string& key, uint32_t default_value ) {
+      return std::stoul( enu_system_tester::test_arg( key, std::to_string( default_value ) ) );
+   }
+
+   /// prefix followed by the index in letters, fixed width so that the names sort by index
+   account_name benchmark_account( const std::string& prefix, uint32_t index ) {
+      std::string suffix( 4, 'a' );
+      for( int i = 3; i >= 0; --i ) {
+         suffix[i] = 'a' + index % 26;
+         index /= 26;
+      }
+      return account_name( prefix + suffix );
+   }
+
+   struct cost_stats {
+      uint32_t count           = 0;
+      uint64_t cpu_total_us    = 0;
+      uint32_t cpu_max_us      = 0;
+      uint64_t net_total_words = 0;
+      uint32_t net_max_words   = 0;
+
+      void add( const enu_system_tester::action_cost& cost ) {
+         ++count;
+         cpu_total_us    += cost.cpu_usage_us;
+         cpu_max_us       = std::max( cpu_max_us, cost.cpu_usage_us );
+         net_total_words += cost.net_usage_words;
+         net_max_words    = std::max( net_max_words, cost.net_usage_words );
+      }
+
+      fc::variant to_variant()const {
+         return mvo()
+            ("count", count)
+            ("cpu_us", mvo()("total", cpu_total_us)("avg", count ? cpu_total_us / count : 0)("max", cpu_max_us))
+            ("net_words", mvo()("total", net_total_words)("avg", count ? net_total_words / count : 0)("max", net_max_words));
+      }
+   };
+
+   struct scenario_result {
+      std::string                       name;
+      mvo                               parameters;
+      std::map<std::string, cost_stats> actions;
+   };
+
+   std::deque<scenario_result>& results() {
+      static std::deque<scenario_result> r;
+      return r;
+   }
+
+   /// writes the collected results once every scenario has run
+   struct benchmark_report {
+      ~benchmark_report() {
+         fc::variants scenarios;
+         for( const auto& r : results() ) {
+            mvo actions;
+            for( const auto& a : r.actions ) {
+               actions( a.first, a.second.to_variant() );
+            }
+            scenarios.push_back( mvo()("name", r.name)("parameters", r.parameters)("actions", actions) );
+         }
+         enu_system_tester::write_json_report( mvo()("contract", "enu.system")("scenarios", scenarios) );
+      }
+   };
+
+   class benchmark_tester : public enu_system_tester {
+   public:
+      scenario_result& start_scenario( const std::string& name, const mvo& parameters ) {
+         results().push_back( { name, parameters, {} } );
+         return results().back();
+      }
+
+      void measure( scenario_result& scenario, const account_name& signer, const action_name& name, const variant_object& data ) {
+         scenario.actions[name.to_string()].add( measure_action( signer, name, data ) );
+      }
+
+      mvo delegatebw_data( const account_name& from, const asset& amount ) {
+         return mvo()
+            ("from", from)
+            ("receiver", from)
+            ("stake_net_quantity", amount)
+            ("stake_cpu_quantity", amount)
+            ("transfer", 0);
+      }
+
+      mvo voteproducer_data( const account_name& voter, const std::vector<account_name>& producers, const account_name& proxy = name(0) ) {
+         return mvo()("voter", voter)("proxy", proxy)("producers", producers);
+      }
+
+      std::vector<account_name> register_producers( uint32_t count ) {
+         std::vector<account_name> producers;
+         for( uint32_t i = 0; i < count; ++i ) {
+            producers.push_back( benchmark_account( "benchbp", i ) );
+         }
+         for( size_t i = 0; i < producers.size(); i += 20 ) {
+            setup_producer_accounts( std::vector<account_name>( producers.begin() + i,
+                                                                producers.begin() + std::min( producers.size(), i + 20 ) ) );
+            produce_block();
+         }
+         for( const auto& p : producers ) {
+            regproducer( p );
+         }
+         produce_block();
+         return producers;
+      }
+
+      std::vector<account_name> create_funded_accounts( const std::string& prefix, uint32_t count ) {
+         std::vector<account_name> accounts;
+         for( uint32_t i = 0; i < count; ++i ) {
+            accounts.push_back( benchmark_account( prefix, i ) );
+            create_account_with_resources( accounts.back(), config::system_account_name );
+            issue( accounts.back(), core_sym::from_string("1000.0000") );
+         }
+         produce_block();
+         return accounts;
+      }
+   };
+
+   /// voters never vote for more than 30 producers
+   std::vector<account_name> vote_set( const std::vector<account_name>& producers ) {
+      return std::vector<account_name>( producers.begin(), producers.begin() + std::min<size_t>( producers.size(), 30 ) );
+   }
+
+}
+
+BOOST_GLOBAL_FIXTURE( benchmark_report );
+
+BOOST_AUTO_TEST_SUITE(system_benchmark)
+
+// N voters each staking and voting for up to 30 of M producers, then changing their stake
+BOOST_FIXTURE_TEST_CASE( voters_and_producers, benchmark_tester ) try {
+   const uint32_t voter_count    = benchmark_param( "voters", 5 );
+   const uint32_t producer_count = benchmark_param( "producers", 5 );
+   auto& scenario = start_scenario( "voters_and_producers", mvo()("voters", voter_count)("producers", producer_count) );
+
+   const auto producers = register_producers( producer_count );
+   const auto voters    = create_funded_accounts( "benchvt", voter_count );
+
+   for( const auto& v : voters ) {
+      measure( scenario, v, N(delegatebw), delegatebw_data( v, core_sym::from_string("10.0000") ) );
+      measure( scenario, v, N(voteproducer), voteproducer_data( v, vote_set( producers ) ) );
+   }
+   // stake changes of voters that already voted move the weight of every producer they vote for
+   for( const auto& v : voters ) {
+      measure( scenario, v, N(delegatebw), delegatebw_data( v, core_sym::from_string("1.0000") ) );
+   }
+} FC_LOG_AND_RETHROW()
+
+// D voters delegating to one proxy that votes for up to 30 of M producers. Proxies can not use
+// a proxy themselves, so the weight of a delegator always passes through exactly one proxy.
+BOOST_FIXTURE_TEST_CASE( proxy_delegators, benchmark_tester ) try {
+   const uint32_t delegator_count = benchmark_param( "delegators", 5 );
+   const uint32_t producer_count  = benchmark_param( "producers", 5 );
+   auto& scenario = start_scenario( "proxy_delegators", mvo()("delegators", delegator_count)("producers", producer_count) );
+
+   const auto producers  = register_producers( producer_count );
+   const auto proxy      = create_funded_accounts( "benchpx", 1 ).front();
+   const auto delegators = create_funded_accounts( "benchdg", delegator_count );
+
+   BOOST_REQUIRE_EQUAL( success(), stake( proxy, core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   measure( scenario, proxy, N(regproxy), mvo()("proxy", proxy)("isproxy", true) );
+   measure( scenario, proxy, N(voteproducer), voteproducer_data( proxy, vote_set( producers ) ) );
+
+   for( const auto& d : delegators ) {
+      measure( scenario, d, N(delegatebw), delegatebw_data( d, core_sym::from_string("10.0000") ) );
+      measure( scenario, d, N(voteproducer), voteproducer_data( d, {}, proxy ) );
+   }
+   for( const auto& d : delegators ) {
+      measure( scenario, d, N(delegatebw), delegatebw_data( d, core_sym::from_string("1.0000") ) );
+   }
+   // the proxy moves all delegated weight at once
+   const std::vector<account_name> last_producers( producers.end() - vote_set( producers ).size(), producers.end() );
+   measure( scenario, proxy, N(voteproducer), voteproducer_data( proxy, last_producers ) );
+} FC_LOG_AND_RETHROW()
+
+// a burst of RAM purchases and sales by one trader
+BOOST_FIXTURE_TEST_CASE( ram_trading_burst, benchmark_tester ) try {
+   const uint32_t trades = benchmark_param( "ram_trades", 5 );
+   auto& scenario = start_scenario( "ram_trading_burst", mvo()("ram_trades", trades) );
+
+   const auto trader = create_funded_accounts( "benchrm", 1 ).front();
+   for( uint32_t i = 0; i < trades; ++i ) {
+      measure( scenario, trader, N(buyram), mvo()("payer", trader)("receiver", trader)("quant", core_sym::from_string("1.0000")) );
+      measure( scenario, trader, N(buyrambytes), mvo()("payer", trader)("receiver", trader)("bytes", 1024) );
+      measure( scenario, trader, N(sellram), mvo()("account", trader)("bytes", 1024) );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,8 +9,10 @@
 #include "contracts.hpp"
 #include "test_symbol.hpp"
 
+#include <fc/io/json.hpp>
 #include <fc/variant_object.hpp>
 #include <fstream>
+#include <iostream>
 
 using namespace enumivo::chain;
 using namespace enumivo::testing;
@@ -271,6 +273,88 @@ public:
          return base_tester::push_action( std::move(act), auth ? uint64_t(signer) : signer == N(bob111111111) ? N(alice1111111) : N(bob111111111) );
    }
 
+   /**
+    * Cost billed by the chain for a single system contract action pushed in its own transaction.
+    * `dispatched_actions` counts the action itself plus every inline action and notification it caused.
+    */
+   struct action_cost {
+      uint32_t cpu_usage_us       = 0;
+      uint32_t net_usage_words    = 0;
+      uint32_t dispatched_actions = 0;
+   };
+
+   static uint32_t count_action_traces( const vector<action_trace>& traces ) {
+      uint32_t count = 0;
+      for( const auto& t : traces ) {
+         count += 1 + count_action_traces( t.inline_traces );
+      }
+      return count;
+   }
+
+   /**
+    * Instrumentation mode for the hot paths of the system contract: pushes the action, produces a block and reports
+    * what was billed for it, so that tests can pin the amount of work done per action and regressions show up in CI.
+    */
+   action_cost measure_action( const account_name& signer, const action_name& name, const variant_object& data ) {
+      auto trace = base_tester::push_action( config::system_account_name, name, signer, data );
+      produce_block();
+      BOOST_REQUIRE_EQUAL( true, chain_has_transaction(trace->id) );
+
+      action_cost cost;
+      cost.cpu_usage_us       = trace->receipt->cpu_usage_us;
+      cost.net_usage_words    = trace->receipt->net_usage_words.value;
+      cost.dispatched_actions = count_action_traces( trace->action_traces );
+      return cost;
+   }
+
+   /**
+    * Average time spent executing the onblock action over the next `blocks` blocks.
+    */
+   fc::microseconds measure_onblock( uint32_t blocks ) {
+      int64_t  total_us = 0;
+      uint32_t count    = 0;
+      boost::signals2::scoped_connection conn = control->applied_transaction.connect( [&]( const transaction_trace_ptr& t ) {
+         if( t && t->action_traces.size() > 0 && t->action_traces[0].act.name == N(onblock) ) {
+            total_us += t->elapsed.count();
+            ++count;
+         }
+      });
+      produce_blocks( blocks );
+      BOOST_REQUIRE( count > 0 );
+      return fc::microseconds( total_us / count );
+   }
+
+   /**
+    * Value of a `--key=value` argument passed to the test executable after `--`, or `default_value` when absent.
+    */
+   static std::string test_arg( const std::string& key, const std::string& default_value ) {
+      const std::string prefix = "--" + key + "=";
+      auto& suite = boost::unit_test::framework::master_test_suite();
+      for( int i = 1; i < suite.argc; ++i ) {
+         const std::string arg = suite.argv[i];
+         if( arg.compare( 0, prefix.size(), prefix ) == 0 ) {
+            return arg.substr( prefix.size() );
+         }
+      }
+      return default_value;
+   }
+
+   /**
+    * Writes `report` as JSON to the file given with `--output`. Without it the report is printed to stdout
+    * between the two marker lines below, since the test runner writes its own messages to stdout too.
+    */
+   static void write_json_report( const fc::variant& report ) {
+      const std::string json   = fc::json::to_pretty_string( report );
+      const std::string output = test_arg( "output", "" );
+      if( output.empty() ) {
+         std::cout << "--- begin json report ---" << std::endl
+                   << json << std::endl
+                   << "--- end json report ---" << std::endl;
+      } else {
+         std::ofstream( output ) << json << std::endl;
+      }
+   }
+
    action_result stake( const account_name& from, const account_name& to, const asset& net, const asset& cpu ) {
       return push_action( name(from), N(delegatebw), mvo()
                           ("from",     from)
@@ -382,7 +466,20 @@ public:
 
    fc::variant get_producer_info( const account_name& act ) {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), act );
-      return abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time );
+      fc::variant info = abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time );
+      fc::mutable_variant_object merged( info.get_object() );
+      // blocks produced since the last claim are counted in the prodblocks table
+      vector<char> counter = get_row_by_account( config::system_account_name, config::system_account_name, N(prodblocks), act );
+      if( !counter.empty() ) {
+         fc::variant blocks = abi_ser.binary_to_variant( "producer_blocks", counter, abi_serializer_max_time );
+         merged.set( "unpaid_blocks", info["unpaid_blocks"].as<uint32_t>() + blocks["unpaid_blocks"].as<uint32_t>() );
+      }
+      // the url is kept in the prodmeta table
+      vector<char> meta = get_row_by_account( config::system_account_name, config::system_account_name, N(prodmeta), act );
+      if( !meta.empty() ) {
+         merged.set( "url", abi_ser.binary_to_variant( "producer_meta", meta, abi_serializer_max_time )["url"] );
+      }
+      return fc::variant( merged );
    }
 
    fc::variant get_producer_info2( const account_name& act ) {
@@ -454,6 +551,17 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "enumivo_global_state3", data, abi_serializer_max_time );
    }
 
+   fc::variant get_global_state4() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global4), N(global4) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "enumivo_global_state4", data, abi_serializer_max_time );
+   }
+
+   fc::variant get_rammarket() {
+      const symbol ramcore_symbol = symbol( SY(4,RAMCORE) );
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(rammarket), ramcore_symbol.value() );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "exchange_state", data, abi_serializer_max_time );
+   }
+
    fc::variant get_refund_request( name account ) {
       vector<char> data = get_row_by_account( config::system_account_name, account, N(refunds), account );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "refund_request", data, abi_serializer_max_time );
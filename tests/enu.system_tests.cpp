@@ -3,14 +3,19 @@
 #include <enumivo/chain/global_property_object.hpp>
 #include <enumivo/chain/resource_limits.hpp>
 #include <enumivo/chain/wast_to_wasm.hpp>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <sstream>
+#include <fc/io/json.hpp>
 #include <fc/log/logger.hpp>
 #include <enumivo/chain/exceptions.hpp>
 #include <Runtime/Runtime.h>
 
 #include "enu.system_tester.hpp"
+#include "../enu.system/include/enu.system/name_utils.hpp"
 struct _abi_hash {
    name owner;
    fc::sha256 hash;
@@ -685,6 +690,149 @@ BOOST_FIXTURE_TEST_CASE( stake_to_another_user_not_from_refund, enu_system_teste
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( stake_unstake_action_costs, enu_system_tester ) try {
+   cross_15_percent_threshold();
+
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+
+   // delegatebw to self: the action, one inline transfer to enu.stake and its two notifications
+   auto cost = measure_action( N(alice1111111), N(delegatebw), mvo()
+                               ("from",     "alice1111111")
+                               ("receiver", "alice1111111")
+                               ("stake_net_quantity", core_sym::from_string("200.0000"))
+                               ("stake_cpu_quantity", core_sym::from_string("100.0000"))
+                               ("transfer", 0 )
+   );
+   BOOST_TEST_MESSAGE( "delegatebw to self: cpu " << cost.cpu_usage_us << " us, net " << cost.net_usage_words << " words" );
+   BOOST_REQUIRE_EQUAL( 4, cost.dispatched_actions );
+
+   // delegatebw to another account
+   cost = measure_action( N(alice1111111), N(delegatebw), mvo()
+                          ("from",     "alice1111111")
+                          ("receiver", "bob111111111")
+                          ("stake_net_quantity", core_sym::from_string("20.0000"))
+                          ("stake_cpu_quantity", core_sym::from_string("10.0000"))
+                          ("transfer", 0 )
+   );
+   BOOST_TEST_MESSAGE( "delegatebw to other: cpu " << cost.cpu_usage_us << " us, net " << cost.net_usage_words << " words" );
+   BOOST_REQUIRE_EQUAL( 4, cost.dispatched_actions );
+
+   // undelegatebw only schedules the deferred refund
+   cost = measure_action( N(alice1111111), N(undelegatebw), mvo()
+                          ("from",     "alice1111111")
+                          ("receiver", "alice1111111")
+                          ("unstake_net_quantity", core_sym::from_string("100.0000"))
+                          ("unstake_cpu_quantity", core_sym::from_string("50.0000"))
+   );
+   BOOST_TEST_MESSAGE( "undelegatebw: cpu " << cost.cpu_usage_us << " us, net " << cost.net_usage_words << " words" );
+   BOOST_REQUIRE_EQUAL( 1, cost.dispatched_actions );
+
+   // staking back from the pending refund does not move tokens
+   cost = measure_action( N(alice1111111), N(delegatebw), mvo()
+                          ("from",     "alice1111111")
+                          ("receiver", "alice1111111")
+                          ("stake_net_quantity", core_sym::from_string("100.0000"))
+                          ("stake_cpu_quantity", core_sym::from_string("50.0000"))
+                          ("transfer", 0 )
+   );
+   BOOST_REQUIRE_EQUAL( 1, cost.dispatched_actions );
+   BOOST_REQUIRE_EQUAL( true, get_refund_request( "alice1111111" ).is_null() );
+
+   auto total = get_total_stake( "alice1111111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("210.0000"), total["net_weight"].as<asset>());
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("110.0000"), total["cpu_weight"].as<asset>());
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("330.0000") ), get_voter_info( "alice1111111" ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bulk_delegate, enu_system_tester ) try {
+   cross_15_percent_threshold();
+
+   issue( "alice1111111", core_sym::from_string("10000.0000"),  config::system_account_name );
+
+   const uint32_t receiver_count = 10;
+   std::vector<account_name> bulk_receivers, single_receivers;
+   for( uint32_t i = 0; i < receiver_count; ++i ) {
+      bulk_receivers.emplace_back( std::string("bulkrecver") + char('a' + i) );
+      single_receivers.emplace_back( std::string("looprecver") + char('a' + i) );
+   }
+   create_accounts_with_resources( bulk_receivers );
+   create_accounts_with_resources( single_receivers );
+
+   // receivers must be other accounts and every entry must stake something
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("use delegatebw to stake to self"),
+                        push_action( N(alice1111111), N(bulkdelegate), mvo()
+                                     ("from", "alice1111111")
+                                     ("delegations", variants{ mvo()("receiver", "alice1111111")
+                                                                    ("stake_net_quantity", core_sym::from_string("1.0000"))
+                                                                    ("stake_cpu_quantity", core_sym::from_string("1.0000")) }) )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must stake a positive amount"),
+                        push_action( N(alice1111111), N(bulkdelegate), mvo()
+                                     ("from", "alice1111111")
+                                     ("delegations", variants{ mvo()("receiver", bulk_receivers[0])
+                                                                    ("stake_net_quantity", core_sym::from_string("0.0000"))
+                                                                    ("stake_cpu_quantity", core_sym::from_string("0.0000")) }) )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no delegations specified"),
+                        push_action( N(alice1111111), N(bulkdelegate), mvo()
+                                     ("from", "alice1111111")
+                                     ("delegations", variants()) )
+   );
+
+   variants delegations;
+   for( const auto& r : bulk_receivers ) {
+      delegations.push_back( mvo()
+                             ("receiver", r)
+                             ("stake_net_quantity", core_sym::from_string("20.0000"))
+                             ("stake_cpu_quantity", core_sym::from_string("10.0000")) );
+   }
+   auto bulk_cost = measure_action( N(alice1111111), N(bulkdelegate), mvo()
+                                    ("from", "alice1111111")
+                                    ("delegations", delegations)
+   );
+
+   action_cost loop_cost;
+   for( const auto& r : single_receivers ) {
+      auto cost = measure_action( N(alice1111111), N(delegatebw), mvo()
+                                  ("from",     "alice1111111")
+                                  ("receiver", r)
+                                  ("stake_net_quantity", core_sym::from_string("20.0000"))
+                                  ("stake_cpu_quantity", core_sym::from_string("10.0000"))
+                                  ("transfer", 0 )
+      );
+      loop_cost.cpu_usage_us       += cost.cpu_usage_us;
+      loop_cost.net_usage_words    += cost.net_usage_words;
+      loop_cost.dispatched_actions += cost.dispatched_actions;
+   }
+   BOOST_TEST_MESSAGE( "bulkdelegate to " << receiver_count << " receivers: cpu " << bulk_cost.cpu_usage_us
+                       << " us, net " << bulk_cost.net_usage_words << " words" );
+   BOOST_TEST_MESSAGE( receiver_count << " x delegatebw: cpu " << loop_cost.cpu_usage_us
+                       << " us, net " << loop_cost.net_usage_words << " words" );
+
+   // a single transfer to enu.stake (with its two notifications) for the whole batch
+   BOOST_REQUIRE_EQUAL( 4, bulk_cost.dispatched_actions );
+   BOOST_REQUIRE_EQUAL( 4 * receiver_count, loop_cost.dispatched_actions );
+
+   for( uint32_t i = 0; i < receiver_count; ++i ) {
+      auto bulk_total   = get_total_stake( bulk_receivers[i] );
+      auto single_total = get_total_stake( single_receivers[i] );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string("30.0000"), bulk_total["net_weight"].as<asset>() );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string("20.0000"), bulk_total["cpu_weight"].as<asset>() );
+      BOOST_REQUIRE_EQUAL( single_total["net_weight"].as<asset>(), bulk_total["net_weight"].as<asset>() );
+      BOOST_REQUIRE_EQUAL( single_total["cpu_weight"].as<asset>(), bulk_total["cpu_weight"].as<asset>() );
+   }
+
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("9400.0000"), get_balance( "alice1111111" ) );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("600.0000") ), get_voter_info( "alice1111111" ) );
+
+   // stake delegated in bulk is undelegated the usual way
+   BOOST_REQUIRE_EQUAL( success(), unstake( "alice1111111", bulk_receivers[0], core_sym::from_string("20.0000"), core_sym::from_string("10.0000") ) );
+   auto total = get_total_stake( bulk_receivers[0] );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["cpu_weight"].as<asset>() );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("570.0000") ), get_voter_info( "alice1111111" ) );
+} FC_LOG_AND_RETHROW()
+
 // Tests for voting
 BOOST_FIXTURE_TEST_CASE( producer_register_unregister, enu_system_tester ) try {
    issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
@@ -703,6 +851,9 @@ BOOST_FIXTURE_TEST_CASE( producer_register_unregister, enu_system_tester ) try {
    BOOST_REQUIRE_EQUAL( "alice1111111", info["owner"].as_string() );
    BOOST_REQUIRE_EQUAL( 0, info["total_votes"].as_double() );
    BOOST_REQUIRE_EQUAL( "http://block.one", info["url"].as_string() );
+   // the url is stored apart from the producer row rewritten by votes and onblock
+   vector<char> row = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), N(alice1111111) );
+   BOOST_REQUIRE_EQUAL( "", abi_ser.binary_to_variant( "producer_info", row, abi_serializer_max_time )["url"].as_string() );
 
    //change parameters one by one to check for things like #3783
    //fc::variant params2 = producer_parameters_example(2);
@@ -980,6 +1131,149 @@ BOOST_FIXTURE_TEST_CASE( producer_keep_votes, enu_system_tester, * boost::unit_t
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( refresh_vote_weight, enu_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "alice1111111" ) );
+
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("13.0000"), core_sym::from_string("0.5791") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+
+   issue( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("22.0000"), core_sym::from_string("0.2222") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(regproxy), mvo()("proxy", "carol1111111")("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(alice1111111) } ) );
+
+   const double initial_votes = get_producer_info( "alice1111111" )["total_votes"].as_double();
+   BOOST_TEST_REQUIRE( stake2votes("35.8013") == initial_votes );
+
+   // vote weight grows weekly, but is only applied when the voter acts again
+   produce_block( fc::days(8) );
+   BOOST_TEST_REQUIRE( initial_votes == get_producer_info( "alice1111111" )["total_votes"].as_double() );
+   BOOST_REQUIRE( stake2votes("35.8013") > initial_votes );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of bob111111111"),
+                        push_action( N(bob111111111), N(refreshvote), mvo()("voter", "bob111111111"), false ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("user must stake before they can vote"),
+                        push_action( N(alice1111111), N(refreshvote), mvo()("voter", "alice1111111") ) );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(refreshvote), mvo()("voter", "bob111111111") ) );
+   BOOST_TEST_REQUIRE( stake2votes("13.5791") == get_voter_info( "bob111111111" )["last_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( 1, get_voter_info( "bob111111111" )["producers"].size() );
+
+   // anyone can refresh a batch of voters, accounts that did not vote are skipped
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(refreshvotes),
+                                                mvo()("voters", vector<account_name>{ N(alice1111111), N(carol1111111) }) ) );
+   BOOST_TEST_REQUIRE( stake2votes("22.2222") == get_voter_info( "carol1111111" )["last_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes("35.8013") == get_producer_info( "alice1111111" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes("35.8013") == get_global_state()["total_producer_vote_weight"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( clean_inactive_producers, enu_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "bob111111111" ) );
+
+   issue( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(alice1111111), N(bob111111111) } ) );
+   cross_15_percent_threshold();
+
+   // bob111111111 leaves and loses its last votes, alice1111111 stays registered without votes
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(unregprod), mvo()("producer", "bob111111111") ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "carol1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_TEST_REQUIRE( 0 == get_producer_info( "bob111111111" )["total_votes"].as_double() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("limit must be positive"),
+                        push_action( N(alice1111111), N(cleanprods), mvo()("lower_bound", "")("limit", 0) ) );
+
+   auto is_registered = [&]( account_name producer ) {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(producers), producer ).empty();
+   };
+
+   // bob111111111 left too recently, the page is scanned without erasing anything
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(cleanprods), mvo()("lower_bound", "")("limit", 10) ) );
+   BOOST_REQUIRE( is_registered( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( "", get_global_state4()["cleanprods_next"].as_string() );
+
+   produce_block( fc::days(31) );
+   produce_blocks(1);
+
+   // the page ends before bob111111111 and tells where to continue
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(cleanprods), mvo()("lower_bound", "")("limit", 1) ) );
+   BOOST_REQUIRE( is_registered( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( "bob111111111", get_global_state4()["cleanprods_next"].as_string() );
+   // anyone can clean up
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(cleanprods), mvo()("lower_bound", "bob111111111")("limit", 1) ) );
+   BOOST_REQUIRE_EQUAL( "producer1111", get_global_state4()["cleanprods_next"].as_string() );
+   BOOST_REQUIRE( !is_registered( N(bob111111111) ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), N(bob111111111) ).empty() );
+   BOOST_REQUIRE_EQUAL( "alice1111111", get_producer_info( "alice1111111" )["owner"].as_string() );
+   BOOST_REQUIRE_EQUAL( "producer1111", get_producer_info( "producer1111" )["owner"].as_string() );
+
+   // the stored vote still lists bob111111111, it is dropped once carol1111111 stakes again
+   BOOST_REQUIRE_EQUAL( 2, get_voter_info( "carol1111111" )["producers"].size() );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   auto carol_producers = get_voter_info( "carol1111111" )["producers"];
+   BOOST_REQUIRE_EQUAL( 1, carol_producers.size() );
+   BOOST_REQUIRE_EQUAL( "alice1111111", carol_producers[0].as_string() );
+   BOOST_TEST_REQUIRE( stake2votes("20.0000") == get_producer_info( "alice1111111" )["total_votes"].as_double() );
+
+   // the name can be registered again from scratch
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "bob111111111" ) );
+   BOOST_TEST_REQUIRE( 0 == get_producer_info( "bob111111111" )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
+// a tally can come out slightly below zero once every vote is withdrawn, it is cut to zero
+BOOST_FIXTURE_TEST_CASE( withdrawn_votes_clamp_tally_to_zero, enu_system_tester ) try {
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+
+   issue( "bob111111111", core_sym::from_string("1000000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("500000.0000"), core_sym::from_string("500000.0000") ) );
+   const double big = stake2votes( core_sym::from_string("1000000.0000") );
+
+   // find a small stake whose weight is rounded down when it is added to the big one, by well
+   // below half of the spacing of doubles there so that the choice does not depend on the last bits
+   int64_t small_amount = 0;
+   double  small        = 0;
+   for( int64_t amount = 1; amount < 100000 && small_amount == 0; ++amount ) {
+      const double weight  = stake2votes( asset( amount, symbol{CORE_SYM} ) );
+      const double sum     = big + weight;
+      const double spacing = std::nextafter( sum, std::numeric_limits<double>::infinity() ) - sum;
+      const double rest    = std::fmod( weight, spacing );
+      if( 0.1 * spacing < rest && rest < 0.4 * spacing ) {
+         small_amount = amount;
+         small        = weight;
+      }
+   }
+   BOOST_REQUIRE( 0 < small_amount );
+   BOOST_REQUIRE( ( (big + small) - big ) - small < 0 );
+
+   issue( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", asset( small_amount, symbol{CORE_SYM} ), core_sym::from_string("0.0000") ) );
+
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1) } ) );
+
+   // both move to defproducer2, the rounding error of the first sum is left behind in defproducer1
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer2) } ) );
+   BOOST_REQUIRE( 0 < get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( 0.0, get_producer_info( "defproducer1" )["total_votes"].as_double() );
+
+   const double producer2_votes = get_producer_info( "defproducer2" )["total_votes"].as_double();
+   BOOST_REQUIRE_EQUAL( big + small, producer2_votes );
+   BOOST_REQUIRE_EQUAL( producer2_votes, get_global_state()["total_producer_vote_weight"].as_double() );
+
+   // the tally keeps working from zero
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( small, get_producer_info( "defproducer1" )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( vote_for_two_producers, enu_system_tester, * boost::unit_test::tolerance(1e+5) ) try {
    //alice1111111 becomes a producer
    fc::variant params = producer_parameters_example(1);
@@ -1384,6 +1678,154 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, enu_system_tester, * boost::unit_test::tol
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE(onblock_before_activation_is_cheap, enu_system_tester) try {
+
+   // before activation onblock only records the block time in global2
+   auto is_counted = [&]() {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(prodblocks), N(producer1111) ).empty();
+   };
+   const auto global_state  = fc::json::to_string( get_global_state() );
+   const auto global_state2 = get_global_state2();
+   const auto global_state3 = fc::json::to_string( get_global_state3() );
+   BOOST_REQUIRE( !is_counted() );
+
+   const auto pre_activation = measure_onblock( 50 );
+   BOOST_REQUIRE_EQUAL( control->pending_block_time().time_since_epoch().count(),
+                        time_point::from_iso_string( get_global_state2()["last_block_num"].as_string() ).time_since_epoch().count() );
+   BOOST_REQUIRE_EQUAL( global_state,  fc::json::to_string( get_global_state() ) );
+   BOOST_REQUIRE_EQUAL( global_state3, fc::json::to_string( get_global_state3() ) );
+   BOOST_REQUIRE_EQUAL( fc::json::to_string( global_state2 ),
+                        fc::json::to_string( mvo( get_global_state2().get_object() )("last_block_num", global_state2["last_block_num"]) ) );
+   BOOST_REQUIRE( !is_counted() );
+
+   cross_15_percent_threshold();
+   produce_blocks( 250 );
+   const auto post_activation = measure_onblock( 50 );
+   BOOST_REQUIRE( is_counted() );
+
+   BOOST_TEST_MESSAGE( "onblock before activation: " << pre_activation.count() << " us, after: " << post_activation.count() << " us" );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE(onblock_counts_blocks_outside_producer_row, enu_system_tester) try {
+
+   cross_15_percent_threshold();
+   produce_blocks( 250 );
+
+   // blocks are counted in prodblocks, the producer row itself is left untouched
+   const uint32_t unpaid_blocks = get_producer_info( N(producer1111) )["unpaid_blocks"].as<uint32_t>();
+   BOOST_REQUIRE( 0 < unpaid_blocks );
+   vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), N(producer1111) );
+   BOOST_REQUIRE_EQUAL( 0, abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( unpaid_blocks, get_global_state()["total_unpaid_blocks"].as<uint32_t>() );
+
+   const auto elapsed = measure_onblock( 100 );
+   BOOST_TEST_MESSAGE( "onblock: " << elapsed.count() << " us per call" );
+
+   produce_block( fc::hours(25) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(producer1111), N(claimrewards), mvo()("owner", "producer1111") ) );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info( N(producer1111) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state()["total_unpaid_blocks"].as<uint32_t>() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE(amortized_bucket_fill, enu_system_tester) try {
+
+   cross_15_percent_threshold();
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of enumivo"),
+                        push_action( N(alice1111111), N(setfillintvl), mvo()("interval", 3600) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("bucket fill interval should be at most one day"),
+                        push_action( config::system_account_name, N(setfillintvl), mvo()("interval", 24 * 3600 + 1) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setfillintvl), mvo()("interval", 3600) ) );
+   BOOST_REQUIRE_EQUAL( 3600, get_global_state4()["bucket_fill_interval"].as<uint32_t>() );
+
+   const auto    initial_global_state = get_global_state();
+   const asset   initial_supply       = get_token_supply();
+   const int64_t initial_pervote      = initial_global_state["pervote_bucket"].as<int64_t>();
+   const int64_t initial_perblock     = initial_global_state["perblock_bucket"].as<int64_t>();
+
+   // onblock fills the buckets once the interval has passed, without any claim. It only does the
+   // accounting, no tokens are issued or moved by onblock.
+   const asset initial_savings = get_balance( N(enu.savings) );
+   produce_block( fc::hours(25) );
+   produce_blocks( 2 );
+   const auto global_state  = get_global_state();
+   const auto global_state4 = get_global_state4();
+   BOOST_REQUIRE( initial_global_state["last_pervote_bucket_fill"].as_string() != global_state["last_pervote_bucket_fill"].as_string() );
+   BOOST_REQUIRE_EQUAL( initial_supply, get_token_supply() );
+   BOOST_REQUIRE_EQUAL( initial_savings, get_balance( N(enu.savings) ) );
+   const int64_t unissued_pervote  = global_state4["unissued_pervote"].as<int64_t>();
+   const int64_t unissued_perblock = global_state4["unissued_perblock"].as<int64_t>();
+   const int64_t unissued_savings  = global_state4["unissued_savings"].as<int64_t>();
+   BOOST_REQUIRE( 0 < unissued_savings );
+   BOOST_REQUIRE_EQUAL( initial_pervote + unissued_pervote, global_state["pervote_bucket"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( initial_perblock + unissued_perblock, global_state["perblock_bucket"].as<int64_t>() );
+
+   // anyone can issue what onblock filled in
+   const asset supply = get_token_supply();
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(issuefills), mvo() ) );
+   BOOST_REQUIRE_EQUAL( supply.get_amount() + unissued_savings + unissued_perblock + unissued_pervote, get_token_supply().get_amount() );
+   BOOST_REQUIRE_EQUAL( initial_savings.get_amount() + unissued_savings, get_balance( N(enu.savings) ).get_amount() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state4()["unissued_savings"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no bucket fills to issue"), push_action( N(alice1111111), N(issuefills), mvo() ) );
+
+   // the claim pays out of the buckets without filling them again
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(producer1111), N(claimrewards), mvo()("owner", "producer1111") ) );
+   BOOST_REQUIRE_EQUAL( supply.get_amount() + unissued_savings + unissued_perblock + unissued_pervote, get_token_supply().get_amount() );
+   BOOST_REQUIRE_EQUAL( global_state["last_pervote_bucket_fill"].as_string(),
+                        get_global_state()["last_pervote_bucket_fill"].as_string() );
+
+   // back to filling on claim
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setfillintvl), mvo()("interval", 0) ) );
+   produce_block( fc::hours(25) );
+   const asset supply_before_claim = get_token_supply();
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(producer1111), N(claimrewards), mvo()("owner", "producer1111") ) );
+   BOOST_REQUIRE( supply_before_claim < get_token_supply() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE(tiny_bucket_fills, enu_system_tester) try {
+
+   cross_15_percent_threshold();
+
+   // the bucket accounts always hold the buckets minus what is filled in but not issued yet
+   auto require_funded_buckets = [&]() {
+      const auto global_state  = get_global_state();
+      const auto global_state4 = get_global_state4();
+      BOOST_REQUIRE_EQUAL( global_state["perblock_bucket"].as<int64_t>() - global_state4["unissued_perblock"].as<int64_t>(),
+                           get_balance( N(enu.blockpay) ).get_amount() );
+      BOOST_REQUIRE_EQUAL( global_state["pervote_bucket"].as<int64_t>() - global_state4["unissued_pervote"].as<int64_t>(),
+                           get_balance( N(enu.votepay) ).get_amount() );
+   };
+
+   // onblock fills the buckets about every second
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setfillintvl), mvo()("interval", 1) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setschedcfg),
+                                                mvo()("max_producers", 21)("refresh_slots", 1) ) );
+   produce_block( fc::hours(25) );
+   produce_blocks( 2 );
+   require_funded_buckets();
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(issuefills), mvo() ) );
+   require_funded_buckets();
+
+   // fills of a second or two are small, issuing them and claiming after them still succeeds
+   produce_blocks( 4 );
+   const auto    global_state4     = get_global_state4();
+   const int64_t unissued_perblock = global_state4["unissued_perblock"].as<int64_t>();
+   BOOST_REQUIRE( 0 < unissued_perblock );
+   BOOST_REQUIRE( unissued_perblock < get_global_state()["perblock_bucket"].as<int64_t>() / 1000 );
+   require_funded_buckets();
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(producer1111), N(claimrewards), mvo()("owner", "producer1111") ) );
+   require_funded_buckets();
+   produce_blocks( 2 );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(issuefills), mvo() ) );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state4()["unissued_perblock"].as<int64_t>() );
+   require_funded_buckets();
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, enu_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    auto within_one = [](int64_t a, int64_t b) -> bool { return std::abs( a - b ) <= 1; };
@@ -2207,6 +2649,141 @@ BOOST_FIXTURE_TEST_CASE(votepay_share_update_order, enu_system_tester, * boost::
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE(lazy_votepay_share_payouts, enu_system_tester, * boost::unit_test::tolerance(1e-10)) try {
+
+   auto within_one = [](int64_t a, int64_t b) -> bool { return std::abs( a - b ) <= 1; };
+
+   cross_15_percent_threshold();
+
+   const asset net = core_sym::from_string("80.0000");
+   const asset cpu = core_sym::from_string("80.0000");
+   const std::vector<account_name> accounts = { N(aliceaccount), N(bobbyaccount), N(carolaccount), N(emilyaccount) };
+   for (const auto& a: accounts) {
+      create_account_with_resources( a, config::system_account_name, core_sym::from_string("1.0000"), false, net, cpu );
+      transfer( config::system_account_name, a, core_sym::from_string("1000.0000"), config::system_account_name );
+   }
+   const auto alice = accounts[0];
+   const auto bob   = accounts[1];
+   const auto carol = accounts[2];
+   const auto emily = accounts[3];
+   const std::vector<account_name> producers = { N(producer1111), carol, emily };
+
+   BOOST_REQUIRE_EQUAL( success(), regproducer( carol ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( emily ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( alice, core_sym::from_string("300.0000"), core_sym::from_string("300.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( bob,   core_sym::from_string("200.0000"), core_sym::from_string("200.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( alice, { carol, emily } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( bob,   { emily } ) );
+
+   // nothing changes the accrual rate, so the global checkpoint is left where it was
+   const string checkpoint = get_global_state3()["last_vpay_state_update"].as_string();
+   const double rate       = get_global_state3()["total_vpay_share_change_rate"].as_double();
+   produce_block( fc::hours(1) );
+   BOOST_REQUIRE_EQUAL( success(), vote( alice, { carol, emily } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( bob,   { emily } ) );
+   BOOST_REQUIRE_EQUAL( checkpoint, get_global_state3()["last_vpay_state_update"].as_string() );
+   BOOST_TEST_REQUIRE( rate == get_global_state3()["total_vpay_share_change_rate"].as_double() );
+
+   produce_block( fc::hours(25) );
+   produce_block( fc::hours(25) );
+
+   std::vector<fc::variant> infos, infos2;
+   for( const auto& p : producers ) {
+      infos.push_back( get_producer_info( p ) );
+      infos2.push_back( get_producer_info2( p ) );
+   }
+   const auto     initial_global_state = get_global_state();
+   const int64_t  initial_pervote      = initial_global_state["pervote_bucket"].as<int64_t>();
+   const int64_t  initial_perblock     = initial_global_state["perblock_bucket"].as<int64_t>();
+   const uint32_t initial_tot_unpaid   = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+   const asset    initial_supply       = get_token_supply();
+   const asset    initial_balance      = get_balance( carol );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( carol, N(claimrewards), mvo()("owner", carol) ) );
+
+   const uint64_t ct = microseconds_since_epoch_of_iso_string( get_producer_info( carol )["last_claim_time"] );
+   BOOST_REQUIRE_EQUAL( ct, microseconds_since_epoch_of_iso_string( get_global_state3()["last_vpay_state_update"] ) );
+
+   // what an eagerly checkpointed total would have been at claim time
+   double total_votepay_share = 0;
+   double carol_votepay_share = 0;
+   for( size_t i = 0; i < producers.size(); ++i ) {
+      const double share = infos2[i]["votepay_share"].as_double()
+                           + infos[i]["total_votes"].as_double()
+                             * double( ( ct - microseconds_since_epoch_of_iso_string( infos2[i]["last_votepay_share_update"] ) ) / 1E6 );
+      total_votepay_share += share;
+      if( producers[i] == carol )
+         carol_votepay_share = share;
+   }
+   BOOST_TEST_REQUIRE( total_votepay_share - carol_votepay_share == get_global_state2()["total_producer_votepay_share"].as_double() );
+
+   const int64_t new_tokens      = get_token_supply().get_amount() - initial_supply.get_amount();
+   const int64_t to_producers    = new_tokens / 5;
+   const int64_t perblock_bucket = initial_perblock + to_producers / 4;
+   const int64_t pervote_bucket  = initial_pervote + to_producers - to_producers / 4;
+
+   const uint32_t unpaid_blocks = infos[1]["unpaid_blocks"].as<uint32_t>();
+   const int64_t  block_pay     = initial_tot_unpaid > 0 ? ( perblock_bucket * unpaid_blocks ) / initial_tot_unpaid : 0;
+   const int64_t  vote_pay      = int64_t( ( carol_votepay_share * pervote_bucket ) / total_votepay_share );
+   BOOST_REQUIRE( vote_pay >= 100 * 10000 );
+
+   BOOST_REQUIRE( within_one( block_pay + vote_pay, get_balance( carol ).get_amount() - initial_balance.get_amount() ) );
+   BOOST_REQUIRE( within_one( pervote_bucket - vote_pay, get_global_state()["pervote_bucket"].as<int64_t>() ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE(revote_skips_unchanged_producers, enu_system_tester, * boost::unit_test::tolerance(1e-10)) try {
+
+   cross_15_percent_threshold();
+
+   const asset net = core_sym::from_string("80.0000");
+   const asset cpu = core_sym::from_string("80.0000");
+   const std::vector<account_name> accounts = { N(aliceaccount), N(carolaccount), N(emilyaccount), N(frankaccount) };
+   for (const auto& a: accounts) {
+      create_account_with_resources( a, config::system_account_name, core_sym::from_string("1.0000"), false, net, cpu );
+      transfer( config::system_account_name, a, core_sym::from_string("1000.0000"), config::system_account_name );
+   }
+   const auto alice = accounts[0];
+   const auto carol = accounts[1];
+   const auto emily = accounts[2];
+   const auto frank = accounts[3];
+
+   BOOST_REQUIRE_EQUAL( success(), regproducer( carol ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( emily ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( frank ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( alice, core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+
+   BOOST_REQUIRE_EQUAL( success(), vote( alice, { carol, emily } ) );
+   produce_block( fc::hours(1) );
+
+   const double last_vote_weight  = get_voter_info( alice )["last_vote_weight"].as_double();
+   const double carol_votes       = get_producer_info( carol )["total_votes"].as_double();
+   const string carol_update      = get_producer_info2( carol )["last_votepay_share_update"].as_string();
+   const string emily_update      = get_producer_info2( emily )["last_votepay_share_update"].as_string();
+
+   // same set, same weight: neither producer row is touched
+   auto cost = measure_action( alice, N(voteproducer), mvo()("voter", alice)("proxy", name(0))("producers", vector<account_name>{ carol, emily }) );
+   BOOST_TEST_MESSAGE( "unchanged revote: cpu " << cost.cpu_usage_us << " us" );
+   BOOST_TEST_REQUIRE( last_vote_weight == get_voter_info( alice )["last_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( carol_votes == get_producer_info( carol )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( carol_update, get_producer_info2( carol )["last_votepay_share_update"].as_string() );
+   BOOST_REQUIRE_EQUAL( emily_update, get_producer_info2( emily )["last_votepay_share_update"].as_string() );
+
+   // only the producers leaving and joining the set are updated
+   BOOST_REQUIRE_EQUAL( success(), vote( alice, { carol, frank } ) );
+   BOOST_REQUIRE_EQUAL( carol_update, get_producer_info2( carol )["last_votepay_share_update"].as_string() );
+   BOOST_REQUIRE( emily_update != get_producer_info2( emily )["last_votepay_share_update"].as_string() );
+   BOOST_TEST_REQUIRE( 0 == get_producer_info( emily )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( carol_votes == get_producer_info( frank )["total_votes"].as_double() );
+
+   // a skipped producer must still be active to be voted for
+   BOOST_REQUIRE_EQUAL( success(), push_action( carol, N(unregprod), mvo()("producer", carol) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "producer is not currently registered" ), vote( alice, { carol, frank } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( alice, { frank } ) );
+   BOOST_TEST_REQUIRE( 0 == get_producer_info( carol )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(votepay_transition, enu_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    const asset net = core_sym::from_string("80.0000");
@@ -2633,6 +3210,60 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, enu_system_t
 } FC_LOG_AND_RETHROW()
 
 
+// stake changes of accounts that already voted only move their weight, directly or through the proxy
+BOOST_FIXTURE_TEST_CASE( stake_changes_move_vote_tallies, enu_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   cross_15_percent_threshold();
+
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+
+   //alice1111111 is a proxy voting for defproducer1, carol1111111 delegates to her
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()("proxy", "alice1111111")("isproxy", true) ) );
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1) } ) );
+   issue( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("5.0000"), core_sym::from_string("5.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), vector<account_name>(), "alice1111111" ) );
+
+   //bob111111111 votes for both producers himself
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1), N(defproducer2) } ) );
+
+   auto check_tallies = [&]( const string& alice_staked, const string& bob_staked, const string& carol_staked ) {
+      const double proxied = stake2votes( carol_staked );
+      BOOST_TEST_REQUIRE( proxied == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+      BOOST_TEST_REQUIRE( stake2votes( alice_staked ) + proxied == get_voter_info( "alice1111111" )["last_vote_weight"].as_double() );
+      BOOST_TEST_REQUIRE( stake2votes( bob_staked ) == get_voter_info( "bob111111111" )["last_vote_weight"].as_double() );
+      BOOST_TEST_REQUIRE( stake2votes( carol_staked ) == get_voter_info( "carol1111111" )["last_vote_weight"].as_double() );
+
+      const double producer1_votes = stake2votes( alice_staked ) + proxied + stake2votes( bob_staked );
+      const double producer2_votes = stake2votes( bob_staked );
+      BOOST_TEST_REQUIRE( producer1_votes == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+      BOOST_TEST_REQUIRE( producer2_votes == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+      BOOST_TEST_REQUIRE( producer1_votes + producer2_votes + get_producer_info( "producer1111" )["total_votes"].as_double()
+                          == get_global_state()["total_producer_vote_weight"].as_double() );
+   };
+   check_tallies( "20.0000", "20.0000", "10.0000" );
+
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1.0000"), core_sym::from_string("0.0000") ) );
+   check_tallies( "20.0000", "21.0000", "10.0000" );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", core_sym::from_string("2.0000"), core_sym::from_string("0.0000") ) );
+   check_tallies( "20.0000", "19.0000", "10.0000" );
+
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("3.0000"), core_sym::from_string("0.0000") ) );
+   check_tallies( "20.0000", "19.0000", "13.0000" );
+   // the smallest possible change is still propagated
+   BOOST_REQUIRE_EQUAL( success(), unstake( "carol1111111", core_sym::from_string("0.0000"), core_sym::from_string("0.0001") ) );
+   check_tallies( "20.0000", "19.0000", "12.9999" );
+
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("0.0000"), core_sym::from_string("4.0000") ) );
+   check_tallies( "24.0000", "19.0000", "12.9999" );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( vote_both_proxy_and_producers, enu_system_tester ) try {
    //alice1111111 becomes a proxy
    BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()
@@ -2718,6 +3349,144 @@ BOOST_FIXTURE_TEST_CASE( double_register_unregister_proxy_keeps_votes, enu_syste
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( recalc_proxied_vote_weight, enu_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   create_accounts_with_resources( { N(donald111111) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "alice1111111" ) );
+
+   issue( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(regproxy), mvo()("proxy", "carol1111111")("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(alice1111111) } ) );
+
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("13.0000"), core_sym::from_string("0.5791") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>(), N(carol1111111) ) );
+   issue( "donald111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "donald111111", core_sym::from_string("5.0000"), core_sym::from_string("5.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(donald111111), vector<account_name>(), N(carol1111111) ) );
+
+   // delegators are listed in the proxyvoters table scoped by their proxy
+   auto is_delegator = [&]( account_name voter ) {
+      return !get_row_by_account( config::system_account_name, N(carol1111111), N(proxyvoters), voter ).empty();
+   };
+   BOOST_REQUIRE( is_delegator( N(bob111111111) ) && is_delegator( N(donald111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE( !is_delegator( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>(), N(carol1111111) ) );
+   BOOST_REQUIRE( is_delegator( N(bob111111111) ) );
+
+   // vote weight grows weekly, the delegators have not refreshed their votes since
+   produce_block( fc::days(8) );
+   BOOST_TEST_REQUIRE( stake2votes("13.5791") > get_voter_info( "bob111111111" )["last_vote_weight"].as_double() );
+
+   // nothing is recounted before the backfill of older votes is marked complete
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("proxy delegators are not fully indexed yet"),
+                        push_action( N(carol1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 1) ) );
+   BOOST_REQUIRE_EQUAL( error("missing authority of enumivo"),
+                        push_action( N(alice1111111), N(setproxyidx), mvo()("complete", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setproxyidx), mvo()("complete", true) ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("proxy not found"),
+                        push_action( N(alice1111111), N(recalcproxy), mvo()("proxy", "alice1111111")("limit", 1) ) );
+
+   // only the proxy can recount, one delegator per call here
+   BOOST_REQUIRE_EQUAL( error("missing authority of carol1111111"),
+                        push_action( N(alice1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 1) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 1) ) );
+   BOOST_REQUIRE( !get_row_by_account( config::system_account_name, config::system_account_name, N(proxyrecount), N(carol1111111) ).empty() );
+   BOOST_REQUIRE_EQUAL( 1, get_global_state4()["active_proxy_recounts"].as_uint64() );
+   BOOST_TEST_REQUIRE( stake2votes("13.5791") == get_voter_info( "bob111111111" )["last_vote_weight"].as_double() );
+
+   // a counted delegator changing its weight in between is included in the result
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1.0000"), core_sym::from_string("0.0000") ) );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 1) ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(proxyrecount), N(carol1111111) ).empty() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state4()["active_proxy_recounts"].as_uint64() );
+   const double proxied = stake2votes("14.5791") + stake2votes("10.0000");
+   BOOST_TEST_REQUIRE( proxied == get_voter_info( "carol1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes("20.0000") + proxied == get_producer_info( "alice1111111" )["total_votes"].as_double() );
+
+   // a limit of 0 drops a recount in progress, and so does unregistering as a proxy
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 1) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 0) ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(proxyrecount), N(carol1111111) ).empty() );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(recalcproxy), mvo()("proxy", "carol1111111")("limit", 1) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(regproxy), mvo()("proxy", "carol1111111")("isproxy", false) ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(proxyrecount), N(carol1111111) ).empty() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state4()["active_proxy_recounts"].as_uint64() );
+
+} FC_LOG_AND_RETHROW()
+
+// a delegator that voted under a contract without the proxyvoters table is only counted once it is indexed
+BOOST_AUTO_TEST_CASE( recalc_proxy_with_unindexed_delegator, * boost::unit_test::tolerance(1e-10) ) try {
+   enu_system_tester t(enu_system_tester::setup_level::minimal);
+
+   std::string old_contract_core_symbol_name = "ENU"; // Set to core symbol used in contracts::util::system_wasm_old()
+   symbol old_contract_core_symbol{::enumivo::chain::string_to_symbol_c( 4, old_contract_core_symbol_name.c_str() )};
+
+   auto old_core_from_string = [&]( const std::string& s ) {
+      return enumivo::chain::asset::from_string(s + " " + old_contract_core_symbol_name);
+   };
+
+   t.create_core_token( old_contract_core_symbol );
+   t.set_code( config::system_account_name, contracts::util::system_wasm_old() );
+   t.set_abi(  config::system_account_name, contracts::util::system_abi_old().data() );
+   {
+      const auto& accnt = t.control->db().get<account_object,by_name>( config::system_account_name );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      t.abi_ser.set_abi(abi, enu_system_tester::abi_serializer_max_time);
+   }
+   const asset net = old_core_from_string("80.0000");
+   const asset cpu = old_core_from_string("80.0000");
+   const account_name proxy = N(producvotera);
+   for (const auto& v: { N(producvotera), N(producvoterb), N(producvoterc) }) {
+      t.create_account_with_resources( v, config::system_account_name, old_core_from_string("1.0000"), false, net, cpu );
+      t.transfer( config::system_account_name, v, old_core_from_string("1000.0000"), config::system_account_name );
+   }
+   t.setup_producer_accounts( { N(defproducera) }, old_core_from_string("1.0000"), net, cpu );
+   BOOST_REQUIRE_EQUAL( t.success(), t.regproducer( N(defproducera) ) );
+
+   BOOST_REQUIRE_EQUAL( t.success(), t.stake( proxy, old_core_from_string("10.0000"), old_core_from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( proxy, N(regproxy), mvo()("proxy", proxy)("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( proxy, { N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.stake( N(producvoterb), old_core_from_string("50.0000"), old_core_from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvoterb), vector<account_name>(), proxy ) );
+
+   t.deploy_contract( false );
+   t.produce_blocks(2);
+
+   BOOST_REQUIRE_EQUAL( t.success(), t.stake( N(producvoterc), old_core_from_string("5.0000"), old_core_from_string("5.0000") ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvoterc), vector<account_name>(), proxy ) );
+
+   auto is_delegator = [&]( account_name voter ) {
+      return !t.get_row_by_account( config::system_account_name, proxy, N(proxyvoters), voter ).empty();
+   };
+   BOOST_REQUIRE( !is_delegator( N(producvoterb) ) && is_delegator( N(producvoterc) ) );
+
+   // recounting now would drop the weight of producvoterb from the proxy
+   BOOST_REQUIRE_EQUAL( t.wasm_assert_msg("proxy delegators are not fully indexed yet"),
+                        t.push_action( proxy, N(recalcproxy), mvo()("proxy", proxy)("limit", 10) ) );
+
+   // the account that backfills pays for the rows
+   BOOST_REQUIRE_EQUAL( t.error("missing authority of producvoterb"),
+                        t.push_action( N(producvoterc), N(indexvoters), mvo()("payer", "producvoterb")("voters", vector<account_name>{ N(producvoterb) }) ) );
+   auto& rlm = t.control->get_resource_limits_manager();
+   const auto payer_ram_usage = rlm.get_account_ram_usage( N(producvoterc) );
+   BOOST_REQUIRE_EQUAL( t.success(),
+                        t.push_action( N(producvoterc), N(indexvoters), mvo()("payer", "producvoterc")("voters", vector<account_name>{ N(producvoterb) }) ) );
+   BOOST_REQUIRE( is_delegator( N(producvoterb) ) );
+   BOOST_REQUIRE( payer_ram_usage < rlm.get_account_ram_usage( N(producvoterc) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(setproxyidx), mvo()("complete", true) ) );
+
+   t.produce_block( fc::days(8) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( proxy, N(recalcproxy), mvo()("proxy", proxy)("limit", 10) ) );
+   const double proxied = t.stake2votes( old_core_from_string("100.0000") ) + t.stake2votes( old_core_from_string("10.0000") );
+   BOOST_TEST_REQUIRE( proxied == t.get_voter_info( proxy )["proxied_vote_weight"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( proxy_cannot_use_another_proxy, enu_system_tester ) try {
    //alice1111111 becomes a proxy
    BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()
@@ -2842,6 +3611,93 @@ BOOST_FIXTURE_TEST_CASE( elect_producers /*_and_parameters*/, enu_system_tester
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( schedule_size_onblock_benchmark, enu_system_tester ) try {
+   BOOST_REQUIRE_EQUAL( error("missing authority of enumivo"),
+                        push_action( N(alice1111111), N(setschedcfg), mvo()("max_producers", 4)("refresh_slots", 1) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max_producers must be between 1 and 125"),
+                        push_action( config::system_account_name, N(setschedcfg), mvo()("max_producers", 126)("refresh_slots", 1) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("refresh_slots must be between 1 and one day"),
+                        push_action( config::system_account_name, N(setschedcfg), mvo()("max_producers", 21)("refresh_slots", 0) ) );
+
+   std::vector<account_name> producer_names;
+   for( char c = 'a'; c <= 'd'; ++c ) {
+      for( char d = 'a'; d <= 'y'; ++d ) {
+         producer_names.emplace_back( std::string("benchprod") + c + d );
+      }
+   }
+   setup_producer_accounts( producer_names );
+   for( const auto& p : producer_names ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+
+   // activate the chain and give every producer some votes, 25 producers per voter
+   transfer( "enumivo", "alice1111111", core_sym::from_string("600000000.0000"), "enumivo" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("300000000.0000"), core_sym::from_string("300000000.0000") ) );
+   const std::vector<account_name> voters = { N(alice1111111), N(bob111111111), N(carol1111111), N(benchvoter11) };
+   create_accounts_with_resources( { N(benchvoter11) } );
+   for( size_t i = 0; i < voters.size(); ++i ) {
+      if( i > 0 ) {
+         transfer( "enumivo", voters[i], core_sym::from_string("1000.0000"), "enumivo" );
+         BOOST_REQUIRE_EQUAL( success(), stake( voters[i], core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+      }
+      BOOST_REQUIRE_EQUAL( success(), vote( voters[i], vector<account_name>( producer_names.begin() + 25 * i, producer_names.begin() + 25 * (i + 1) ) ) );
+   }
+
+   // refresh the schedule on every block so that each measured onblock elects the producers
+   for( uint16_t size : { 4, 21, 50, 100 } ) {
+      BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setschedcfg), mvo()("max_producers", size)("refresh_slots", 1) ) );
+      produce_blocks( 2 );
+      BOOST_REQUIRE_EQUAL( size, get_global_state()["last_producer_schedule_size"].as<uint16_t>() );
+      const auto elapsed = measure_onblock( 20 );
+      BOOST_TEST_MESSAGE( "onblock with " << size << " elected producers: " << elapsed.count() << " us per call" );
+   }
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setschedcfg), mvo()("max_producers", 21)("refresh_slots", 120) ) );
+   BOOST_REQUIRE_EQUAL( 21, get_global_state4()["max_producers"].as<uint16_t>() );
+   BOOST_REQUIRE_EQUAL( 120, get_global_state4()["schedule_refresh_slots"].as<uint32_t>() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( schedule_ordered_by_location, enu_system_tester ) try {
+   const std::vector<account_name> producers = { N(defproducer1), N(defproducer2), N(defproducer3), N(defproducer4) };
+   const std::vector<uint16_t>     locations = { 30, 10, 20, 10 };
+   create_accounts_with_resources( producers );
+   for( size_t i = 0; i < producers.size(); ++i ) {
+      BOOST_REQUIRE_EQUAL( success(), push_action( producers[i], N(regproducer), mvo()
+                                                   ("producer",  producers[i])
+                                                   ("producer_key", get_public_key( producers[i], "active" ) )
+                                                   ("url", "" )
+                                                   ("location", locations[i] ) ) );
+   }
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of enumivo"),
+                        push_action( N(alice1111111), N(setprodorder), mvo()("order", 1) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("unknown schedule order"),
+                        push_action( config::system_account_name, N(setprodorder), mvo()("order", 2) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setprodorder), mvo()("order", 1) ) );
+
+   transfer( "enumivo", "alice1111111", core_sym::from_string("600000000.0000"), "enumivo" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", "alice1111111", core_sym::from_string("300000000.0000"), core_sym::from_string("300000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), producers ) );
+   produce_blocks(250);
+
+   // ordered by location, the name breaks the tie at location 10
+   auto producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 4, producer_keys.size() );
+   BOOST_REQUIRE_EQUAL( name("defproducer2"), producer_keys[0].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer4"), producer_keys[1].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer3"), producer_keys[2].producer_name );
+   BOOST_REQUIRE_EQUAL( name("defproducer1"), producer_keys[3].producer_name );
+
+   // back to name order with the same elected set
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setprodorder), mvo()("order", 0) ) );
+   produce_blocks(250);
+   producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 4, producer_keys.size() );
+   for( size_t i = 0; i < producers.size(); ++i ) {
+      BOOST_REQUIRE_EQUAL( producers[i], producer_keys[i].producer_name );
+   }
+} FC_LOG_AND_RETHROW()
+
 
 BOOST_FIXTURE_TEST_CASE( buyname, enu_system_tester ) try {
    create_accounts_with_resources( { N(dan), N(sam) } );
@@ -2880,6 +3736,64 @@ BOOST_FIXTURE_TEST_CASE( buyname, enu_system_tester ) try {
    create_accounts_with_resources( { N(goodgoodgood) }, N(dan) ); /// 12 char names should succeed
 } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE( name_utils_match_character_loops ) try {
+   // the loops used by newaccount, name::suffix and bidname before the mask versions
+   auto loop_has_dot = []( uint64_t value ) {
+      uint64_t tmp = value >> 4;
+      bool has_dot = false;
+      for( uint32_t i = 0; i < 12; ++i ) {
+         has_dot |= !(tmp & 0x1f);
+         tmp >>= 5;
+      }
+      return has_dot;
+   };
+   auto loop_length = []( uint64_t value ) {
+      if( value & 0xFull ) return 13u;
+      uint32_t length = 0;
+      for( uint32_t i = 0; i < 12; ++i ) {
+         if( (value >> (59 - 5 * i)) & 0x1Full ) length = i + 1;
+      }
+      return length;
+   };
+   auto loop_has_inner_dot = []( uint64_t value ) {
+      bool dot_seen = false, inner_dot = false;
+      for( uint32_t i = 0; i < 12; ++i ) {
+         if( (value >> (59 - 5 * i)) & 0x1Full ) inner_dot |= dot_seen;
+         else dot_seen = true;
+      }
+      return inner_dot || ( dot_seen && (value & 0xFull) );
+   };
+
+   // every combination of dots and characters over the 13 positions, each with several characters
+   std::mt19937_64 rng( 7 );
+   for( uint32_t pattern = 0; pattern < (1u << 13); ++pattern ) {
+      for( uint32_t round = 0; round < 4; ++round ) {
+         uint64_t value = 0;
+         for( uint32_t i = 0; i < 12; ++i ) {
+            if( pattern & (1u << i) ) {
+               const uint64_t c = round == 0 ? 1 : round == 1 ? 31 : 1 + rng() % 31;
+               value |= c << (59 - 5 * i);
+            }
+         }
+         if( pattern & (1u << 12) ) {
+            value |= round == 0 ? 1 : round == 1 ? 15 : 1 + rng() % 15;
+         }
+
+         BOOST_REQUIRE_EQUAL( loop_has_dot( value ), enumivosystem::has_dot( value ) );
+         BOOST_REQUIRE_EQUAL( loop_length( value ), enumivosystem::name_length( value ) );
+         BOOST_REQUIRE_EQUAL( loop_has_inner_dot( value ), enumivosystem::has_inner_dot( value ) );
+         BOOST_REQUIRE_EQUAL( value != 0 && loop_length( value ) < 12 && !loop_has_inner_dot( value ),
+                              enumivosystem::is_premium_name( value ) );
+      }
+   }
+
+   BOOST_REQUIRE_EQUAL( 3u, enumivosystem::name_length( uint64_t( N(dan) ) ) );
+   BOOST_REQUIRE( enumivosystem::is_premium_name( uint64_t( N(dan) ) ) );
+   BOOST_REQUIRE( !enumivosystem::is_premium_name( uint64_t( N(dan.enu) ) ) );
+   BOOST_REQUIRE( !enumivosystem::is_premium_name( uint64_t( N(abcdefg12345) ) ) );
+   BOOST_REQUIRE( !enumivosystem::has_dot( uint64_t( N(abcdefg12345) ) ) );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( bid_invalid_names, enu_system_tester ) try {
    create_accounts_with_resources( { N(dan) } );
 
@@ -3314,6 +4228,34 @@ BOOST_FIXTURE_TEST_CASE( ram_inflation, enu_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( ram_inflation_credited_to_market, enu_system_tester ) try {
+   transfer( config::system_account_name, "alice1111111", core_sym::from_string("1000.0000"), config::system_account_name );
+
+   // without inflation buying ram only moves the market by the bytes bought
+   auto market = get_rammarket();
+   int64_t base_balance = market["base"]["balance"].as<asset>().get_amount();
+   auto bytes_before = get_total_stake( "alice1111111" )["ram_bytes"].as_int64();
+   produce_blocks(10);
+   BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100.0000") ) );
+   auto bought = get_total_stake( "alice1111111" )["ram_bytes"].as_int64() - bytes_before;
+   BOOST_REQUIRE_EQUAL( base_balance - bought, get_rammarket()["base"]["balance"].as<asset>().get_amount() );
+
+   // with inflation the supply growth since the last update is added in the same market update
+   const uint16_t rate = 1000;
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setramrate), mvo()("bytes_per_block", rate) ) );
+   base_balance = get_rammarket()["base"]["balance"].as<asset>().get_amount();
+   produce_blocks(10);
+   bytes_before = get_total_stake( "alice1111111" )["ram_bytes"].as_int64();
+   BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100.0000") ) );
+   bought = get_total_stake( "alice1111111" )["ram_bytes"].as_int64() - bytes_before;
+   BOOST_REQUIRE_EQUAL( base_balance + 11 * rate - bought, get_rammarket()["base"]["balance"].as<asset>().get_amount() );
+
+   base_balance = get_rammarket()["base"]["balance"].as<asset>().get_amount();
+   produce_blocks(5);
+   BOOST_REQUIRE_EQUAL( success(), sellram( "alice1111111", 100 ) );
+   BOOST_REQUIRE_EQUAL( base_balance + 6 * rate + 100, get_rammarket()["base"]["balance"].as<asset>().get_amount() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( enuram_ramusage, enu_system_tester ) try {
    BOOST_REQUIRE_EQUAL( core_sym::from_string("0.0000"), get_balance( "alice1111111" ) );
    transfer( "enumivo", "alice1111111", core_sym::from_string("1000.0000"), "enumivo" );
@@ -3524,6 +4466,254 @@ BOOST_FIXTURE_TEST_CASE( change_limited_account_back_to_unlimited, enu_system_te
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( bulk_buy_ram, enu_system_tester ) try {
+   transfer( "enumivo", "alice1111111", core_sym::from_string("1000.0000"), "enumivo" );
+
+   const std::vector<account_name> receivers = { N(bulkrama1111), N(bulkramb1111), N(bulkramc1111), N(bulkramd1111) };
+   const std::vector<uint32_t>     requested = { 4096, 8192, 1024, 2048 };
+   create_accounts_with_resources( receivers );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no ram purchases specified"),
+                        push_action( N(alice1111111), N(bulkbuyram), mvo()("payer", "alice1111111")("purchases", variants()) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must purchase a positive amount"),
+                        push_action( N(alice1111111), N(bulkbuyram), mvo()
+                                     ("payer", "alice1111111")
+                                     ("purchases", variants{ mvo()("receiver", receivers[0])("bytes", 0) }) )
+   );
+
+   std::vector<uint64_t> initial_bytes;
+   variants purchases;
+   for( size_t i = 0; i < receivers.size(); ++i ) {
+      initial_bytes.push_back( get_total_stake( receivers[i] )["ram_bytes"].as_uint64() );
+      purchases.push_back( mvo()("receiver", receivers[i])("bytes", requested[i]) );
+   }
+
+   const asset initial_alice_balance  = get_balance( "alice1111111" );
+   const asset initial_ram_balance    = get_balance( N(enu.ram) );
+   const asset initial_ramfee_balance = get_balance( N(enu.ramfee) );
+
+   auto cost = measure_action( N(alice1111111), N(bulkbuyram), mvo()
+                               ("payer", "alice1111111")
+                               ("purchases", purchases)
+   );
+   BOOST_TEST_MESSAGE( "bulkbuyram for " << receivers.size() << " receivers: cpu " << cost.cpu_usage_us
+                       << " us, net " << cost.net_usage_words << " words" );
+
+   // one payment and one fee transfer, each with two notifications
+   BOOST_REQUIRE_EQUAL( 7, cost.dispatched_actions );
+
+   const asset paid = initial_alice_balance - get_balance( "alice1111111" );
+   const asset fee  = get_balance( N(enu.ramfee) ) - initial_ramfee_balance;
+   BOOST_REQUIRE_EQUAL( paid - fee, get_balance( N(enu.ram) ) - initial_ram_balance );
+   BOOST_REQUIRE_EQUAL( (paid.get_amount() + 199) / 200, fee.get_amount() );
+
+   uint64_t total_bought = 0;
+   for( size_t i = 0; i < receivers.size(); ++i ) {
+      const uint64_t bought = get_total_stake( receivers[i] )["ram_bytes"].as_uint64() - initial_bytes[i];
+      // buying by bytes is approximate, but each receiver gets its share of what was bought
+      BOOST_REQUIRE( bought * 100 >= requested[i] * 99 );
+      BOOST_REQUIRE( bought * 100 <= requested[i] * 101 );
+      total_bought += bought;
+
+      auto rlm = control->get_resource_limits_manager();
+      int64_t ram_bytes, net_weight, cpu_weight;
+      rlm.get_account_limits( receivers[i], ram_bytes, net_weight, cpu_weight );
+      BOOST_REQUIRE_EQUAL( get_total_stake( receivers[i] )["ram_bytes"].as_uint64() + 1400, ram_bytes );
+   }
+
+   // receivers can sell what they were given
+   BOOST_REQUIRE_EQUAL( success(), sellram( receivers[1], get_total_stake( receivers[1] )["ram_bytes"].as_uint64() - initial_bytes[1] ) );
+   BOOST_REQUIRE_EQUAL( initial_bytes[1], get_total_stake( receivers[1] )["ram_bytes"].as_uint64() );
+   BOOST_REQUIRE( 0 < total_bought );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( onboard_new_account, enu_system_tester ) try {
+   transfer( "enumivo", "alice1111111", core_sym::from_string("1000.0000"), "enumivo" );
+   const asset initial_alice_balance = get_balance( "alice1111111" );
+
+   // the account is created and provisioned by two actions instead of three
+   signed_transaction trx;
+   set_transaction_headers(trx);
+   trx.actions.emplace_back( vector<permission_level>{{N(alice1111111), config::active_name}},
+                             newaccount{
+                                .creator  = N(alice1111111),
+                                .name     = N(onboarded111),
+                                .owner    = authority( get_public_key( N(onboarded111), "owner" ) ),
+                                .active   = authority( get_public_key( N(onboarded111), "active" ) )
+                             });
+   trx.actions.emplace_back( get_action( config::system_account_name, N(onboard),
+                                         vector<permission_level>{{N(alice1111111), config::active_name}},
+                                         mvo()
+                                         ("payer", "alice1111111")
+                                         ("receiver", "onboarded111")
+                                         ("bytes", 4096)
+                                         ("stake_net_quantity", core_sym::from_string("1.0000") )
+                                         ("stake_cpu_quantity", core_sym::from_string("2.0000") )
+                                         ("transfer", false )
+                                       )
+                           );
+   set_transaction_headers(trx);
+   trx.sign( get_private_key( N(alice1111111), "active" ), control->get_chain_id() );
+   push_transaction( trx );
+
+   auto total = get_total_stake( "onboarded111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1.0000"), total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("2.0000"), total["cpu_weight"].as<asset>() );
+   const uint64_t bytes = total["ram_bytes"].as_uint64();
+   BOOST_REQUIRE( bytes * 100 >= 4096 * 99 );
+   BOOST_REQUIRE( bytes * 100 <= 4096 * 101 );
+
+   int64_t ram_bytes, net_weight, cpu_weight;
+   control->get_resource_limits_manager().get_account_limits( N(onboarded111), ram_bytes, net_weight, cpu_weight );
+   BOOST_REQUIRE_EQUAL( bytes + 1400, ram_bytes );
+   BOOST_REQUIRE_EQUAL( 10000, net_weight );
+   BOOST_REQUIRE_EQUAL( 20000, cpu_weight );
+
+   // the stake counts towards the payer's vote weight
+   BOOST_REQUIRE( initial_alice_balance - get_balance( "alice1111111" ) > core_sym::from_string("3.0000") );
+   BOOST_REQUIRE_EQUAL( 30000, get_voter_info( "alice1111111" )["staked"].as_int64() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must stake a positive amount"),
+                        push_action( N(alice1111111), N(onboard), mvo()
+                                     ("payer", "alice1111111")
+                                     ("receiver", "onboarded111")
+                                     ("bytes", 1024)
+                                     ("stake_net_quantity", core_sym::from_string("0.0000") )
+                                     ("stake_cpu_quantity", core_sym::from_string("0.0000") )
+                                     ("transfer", false ) )
+   );
+
+} FC_LOG_AND_RETHROW()
+
+// with the transfer flag, onboard leaves the receiver exactly as buyrambytes followed by delegatebw would
+BOOST_AUTO_TEST_CASE( onboard_matches_separate_actions ) try {
+   enu_system_tester combined, separate;
+
+   auto provision = []( enu_system_tester& t, bool use_onboard ) {
+      t.transfer( "enumivo", "alice1111111", core_sym::from_string("1000.0000"), "enumivo" );
+
+      const vector<permission_level> auth{{N(alice1111111), config::active_name}};
+      const asset net = core_sym::from_string("1.0000");
+      const asset cpu = core_sym::from_string("2.0000");
+      signed_transaction trx;
+      trx.actions.emplace_back( auth,
+                                newaccount{
+                                   .creator  = N(alice1111111),
+                                   .name     = N(onboarded111),
+                                   .owner    = authority( t.get_public_key( N(onboarded111), "owner" ) ),
+                                   .active   = authority( t.get_public_key( N(onboarded111), "active" ) )
+                                });
+      if( use_onboard ) {
+         trx.actions.emplace_back( t.get_action( config::system_account_name, N(onboard), auth,
+                                                 mvo()
+                                                 ("payer", "alice1111111")
+                                                 ("receiver", "onboarded111")
+                                                 ("bytes", 4096)
+                                                 ("stake_net_quantity", net)
+                                                 ("stake_cpu_quantity", cpu)
+                                                 ("transfer", true) ) );
+      } else {
+         trx.actions.emplace_back( t.get_action( config::system_account_name, N(buyrambytes), auth,
+                                                 mvo()
+                                                 ("payer", "alice1111111")
+                                                 ("receiver", "onboarded111")
+                                                 ("bytes", 4096) ) );
+         trx.actions.emplace_back( t.get_action( config::system_account_name, N(delegatebw), auth,
+                                                 mvo()
+                                                 ("from", "alice1111111")
+                                                 ("receiver", "onboarded111")
+                                                 ("stake_net_quantity", net)
+                                                 ("stake_cpu_quantity", cpu)
+                                                 ("transfer", true) ) );
+      }
+      t.set_transaction_headers(trx);
+      trx.sign( t.get_private_key( N(alice1111111), "active" ), t.control->get_chain_id() );
+      t.push_transaction( trx );
+      t.produce_block();
+   };
+   provision( combined, true );
+   provision( separate, false );
+
+   const auto combined_total = combined.get_total_stake( "onboarded111" );
+   const auto separate_total = separate.get_total_stake( "onboarded111" );
+   BOOST_REQUIRE_EQUAL( separate_total["net_weight"].as<asset>(), combined_total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( separate_total["cpu_weight"].as<asset>(), combined_total["cpu_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( separate_total["ram_bytes"].as_uint64(), combined_total["ram_bytes"].as_uint64() );
+
+   // the transferred stake belongs to the receiver and no longer counts for the payer
+   BOOST_REQUIRE_EQUAL( 30000, combined.get_voter_info( "onboarded111" )["staked"].as_int64() );
+   BOOST_REQUIRE_EQUAL( separate.get_voter_info( "onboarded111" )["staked"].as_int64(),
+                        combined.get_voter_info( "onboarded111" )["staked"].as_int64() );
+   BOOST_REQUIRE_EQUAL( separate.get_voter_info( "alice1111111" )["staked"].as_int64(),
+                        combined.get_voter_info( "alice1111111" )["staked"].as_int64() );
+
+   int64_t combined_ram, combined_net, combined_cpu, separate_ram, separate_net, separate_cpu;
+   combined.control->get_resource_limits_manager().get_account_limits( N(onboarded111), combined_ram, combined_net, combined_cpu );
+   separate.control->get_resource_limits_manager().get_account_limits( N(onboarded111), separate_ram, separate_net, separate_cpu );
+   BOOST_REQUIRE_EQUAL( separate_ram, combined_ram );
+   BOOST_REQUIRE_EQUAL( separate_net, combined_net );
+   BOOST_REQUIRE_EQUAL( separate_cpu, combined_cpu );
+
+   BOOST_REQUIRE_EQUAL( separate.get_balance( "onboarded111" ), combined.get_balance( "onboarded111" ) );
+   BOOST_REQUIRE_EQUAL( separate.get_balance( "alice1111111" ), combined.get_balance( "alice1111111" ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( ram_trade_action_costs, enu_system_tester ) try {
+   transfer( "enumivo", "alice1111111", core_sym::from_string("2000.0000"), "enumivo" );
+
+   // buys and sells half of the bought RAM, returns the number of actions dispatched by each trade
+   auto trade = [&]() {
+      const asset initial_alice_balance  = get_balance( "alice1111111" );
+      const asset initial_ram_balance    = get_balance( N(enu.ram) );
+      const asset initial_ramfee_balance = get_balance( N(enu.ramfee) );
+      const uint64_t initial_bytes = get_total_stake( "alice1111111" )["ram_bytes"].as_uint64();
+
+      auto buy_cost = measure_action( N(alice1111111), N(buyram), mvo()
+                                      ("payer", "alice1111111")
+                                      ("receiver", "alice1111111")
+                                      ("quant", core_sym::from_string("200.0000"))
+      );
+      BOOST_TEST_MESSAGE( "buyram: cpu " << buy_cost.cpu_usage_us << " us, net " << buy_cost.net_usage_words << " words" );
+
+      BOOST_REQUIRE_EQUAL( initial_alice_balance - core_sym::from_string("200.0000"), get_balance( "alice1111111" ) );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string("1.0000"), get_balance( N(enu.ramfee) ) - initial_ramfee_balance );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string("199.0000"), get_balance( N(enu.ram) ) - initial_ram_balance );
+
+      const asset alice_balance  = get_balance( "alice1111111" );
+      const asset ram_balance    = get_balance( N(enu.ram) );
+      const asset ramfee_balance = get_balance( N(enu.ramfee) );
+      const uint64_t bytes = get_total_stake( "alice1111111" )["ram_bytes"].as_uint64() - initial_bytes;
+
+      auto sell_cost = measure_action( N(alice1111111), N(sellram), mvo()
+                                       ("account", "alice1111111")
+                                       ("bytes", bytes / 2)
+      );
+      BOOST_TEST_MESSAGE( "sellram: cpu " << sell_cost.cpu_usage_us << " us, net " << sell_cost.net_usage_words << " words" );
+
+      // either way the seller ends up with the proceeds net of the fee
+      const asset tokens_out = ram_balance - get_balance( N(enu.ram) );
+      const asset fee        = get_balance( N(enu.ramfee) ) - ramfee_balance;
+      BOOST_REQUIRE_EQUAL( (tokens_out.get_amount() + 199) / 200, fee.get_amount() );
+      BOOST_REQUIRE_EQUAL( tokens_out - fee, get_balance( "alice1111111" ) - alice_balance );
+      BOOST_REQUIRE( initial_alice_balance > get_balance( "alice1111111" ) );
+
+      return std::make_pair( buy_cost.dispatched_actions, sell_cost.dispatched_actions );
+   };
+
+   // a transfer and a fee transfer, each notifying both parties
+   BOOST_REQUIRE( std::make_pair( 7u, 7u ) == trade() );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of enumivo"),
+                        push_action( N(alice1111111), N(setramfeetr), mvo()("enabled", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setramfeetr), mvo()("enabled", true) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( config::system_account_name, N(setramfeetr), mvo()("enabled", true) ) );
+
+   // a single feetransfer notifying payer, receiver and enu.ramfee
+   BOOST_REQUIRE( std::make_pair( 5u, 5u ) == trade() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( buy_pin_sell_ram, enu_system_tester ) try {
    BOOST_REQUIRE( get_total_stake( "enumivo" ).is_null() );
 
@@ -100,6 +100,22 @@ public:
       );
    }
 
+   action_result feetransfer( account_name from,
+                              account_name to,
+                              asset        quantity,
+                              account_name fee_receiver,
+                              asset        fee,
+                              string       memo ) {
+      return push_action( from, N(feetransfer), mvo()
+           ( "from", from)
+           ( "to", to)
+           ( "quantity", quantity)
+           ( "fee_receiver", fee_receiver)
+           ( "fee", fee)
+           ( "memo", memo)
+      );
+   }
+
    action_result open( account_name owner,
                        const string& symbolname,
                        account_name ram_payer    ) {
@@ -360,6 +376,60 @@ BOOST_FIXTURE_TEST_CASE( transfer_tests, enu_token_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( feetransfer_tests, enu_token_tester ) try {
+
+   auto token = create( N(alice), asset::from_string("1000 CERO"));
+   produce_blocks(1);
+
+   issue( N(alice), N(alice), asset::from_string("1000 CERO"), "hola" );
+
+   BOOST_REQUIRE_EQUAL( success(),
+      feetransfer( N(alice), N(bob), asset::from_string("300 CERO"), N(carol), asset::from_string("2 CERO"), "hola" )
+   );
+
+   REQUIRE_MATCHING_OBJECT( get_account(N(alice), "0,CERO"), mvo()
+      ("balance", "698 CERO")
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(bob), "0,CERO"), mvo()
+      ("balance", "300 CERO")
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "0,CERO"), mvo()
+      ("balance", "2 CERO")
+   );
+
+   // a zero fee does not touch the fee receiver
+   BOOST_REQUIRE_EQUAL( success(),
+      feetransfer( N(alice), N(bob), asset::from_string("98 CERO"), N(carol), asset::from_string("0 CERO"), "hola" )
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(bob), "0,CERO"), mvo()
+      ("balance", "398 CERO")
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "0,CERO"), mvo()
+      ("balance", "2 CERO")
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "overdrawn balance" ),
+      feetransfer( N(alice), N(bob), asset::from_string("600 CERO"), N(carol), asset::from_string("1 CERO"), "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "must transfer positive quantity" ),
+      feetransfer( N(alice), N(bob), asset::from_string("0 CERO"), N(carol), asset::from_string("1 CERO"), "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "fee must not be negative" ),
+      feetransfer( N(alice), N(bob), asset::from_string("1 CERO"), N(carol), asset::from_string("-1 CERO"), "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "fee symbol precision mismatch" ),
+      feetransfer( N(alice), N(bob), asset::from_string("1 CERO"), N(carol), asset::from_string("1.0 CERO"), "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "cannot pay fee to self" ),
+      feetransfer( N(alice), N(bob), asset::from_string("1 CERO"), N(alice), asset::from_string("1 CERO"), "hola" )
+   );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( open_tests, enu_token_tester ) try {
 
    auto token = create( N(alice), asset::from_string("1000 CERO"));
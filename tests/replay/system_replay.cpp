@@ -0,0 +1,189 @@
+#include <boost/test/unit_test.hpp>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+
+#include "../enu.system_tester.hpp"
+
+using namespace enu_system;
+
+/**
+ * Replays a recorded action log against the built contracts and reports throughput and per-action cost.
+ *
+ *    system_replay -- --log=workload.jsonl --block_size=50 --slowest=10 --output=replay.json
+ *
+ * Every line of the log is one JSON object, either an action
+ *
+ *    {"action": "delegatebw", "authorizer": "alice1111111", "data": {...}, "contract": "enumivo"}
+ *
+ * where contract is optional and defaults to enumivo and assets use the core symbol of the tests, or
+ * one of the directives
+ *
+ *    {"accounts": ["alice1111111", ...]}   creates the accounts with resources and funds them
+ *    {"skip_seconds": 86400}               produces the next block that much later
+ *
+ * Authorizers that were not created by an accounts line are created before the replay starts.
+ * Failed actions are reported and the replay goes on with the next line, the run only succeeds
+ * with failures when --allow_failures=1 is passed.
+ *
+ * The report is written as JSON to --output. Without --output it is printed to stdout between
+ * "--- begin json report ---" and "--- end json report ---" lines.
+ */
+namespace {
+
+   struct replayed_action {
+      uint32_t     line = 0;
+      std::string  action;
+      account_name authorizer;
+      int64_t      elapsed_us = 0;
+      uint32_t     cpu_usage_us = 0;
+   };
+
+   struct replay_stats {
+      uint32_t count           = 0;
+      uint32_t failed          = 0;
+      int64_t  elapsed_total_us = 0;
+      uint64_t cpu_total_us    = 0;
+      uint32_t cpu_max_us      = 0;
+      uint32_t dispatched      = 0;
+
+      fc::variant to_variant()const {
+         return mvo()
+            ("count", count)
+            ("failed", failed)
+            ("elapsed_us", mvo()("total", elapsed_total_us)("avg", count ? elapsed_total_us / count : 0))
+            ("cpu_us", mvo()("total", cpu_total_us)("avg", count ? cpu_total_us / count : 0)("max", cpu_max_us))
+            ("dispatched_actions_avg", count ? double(dispatched) / count : 0.0);
+      }
+   };
+
+   class replay_tester : public enu_system_tester {
+   public:
+      void create_funded_account( const account_name& a, const asset& funding ) {
+         if( !created.insert( a ).second ) {
+            return;
+         }
+         // accounts of the tester setup only get funded
+         if( control->db().find<account_object, by_name>( a ) == nullptr ) {
+            create_account_with_resources( a, config::system_account_name, core_sym::from_string("100.0000"), false );
+         }
+         issue( a, funding );
+      }
+
+      std::set<account_name> created;
+   };
+
+}
+
+BOOST_AUTO_TEST_SUITE(system_replay)
+
+BOOST_FIXTURE_TEST_CASE( replay_action_log, replay_tester ) try {
+   const std::string log_path       = test_arg( "log", SAMPLE_WORKLOAD );
+   const uint32_t    block_size     = std::stoul( test_arg( "block_size", "50" ) );
+   const uint32_t    slowest        = std::stoul( test_arg( "slowest", "10" ) );
+   const asset       funding        = core_sym::from_string( test_arg( "funding", "10000.0000" ) );
+   const bool        allow_failures = test_arg( "allow_failures", "0" ) != "0";
+
+   std::vector<std::pair<uint32_t, fc::variant_object>> entries;
+   {
+      std::ifstream in( log_path );
+      BOOST_REQUIRE_MESSAGE( in.good(), "cannot open action log " << log_path );
+      std::string line;
+      for( uint32_t n = 1; std::getline( in, line ); ++n ) {
+         if( line.find_first_not_of( " \t\r" ) == std::string::npos ) continue;
+         entries.emplace_back( n, fc::json::from_string( line ).get_object() );
+      }
+   }
+
+   // accounts listed explicitly first, then every authorizer that is still missing
+   for( const auto& e : entries ) {
+      if( e.second.contains( "accounts" ) ) {
+         for( const auto& a : e.second["accounts"].get_array() ) {
+            create_funded_account( a.as<account_name>(), funding );
+         }
+      }
+   }
+   for( const auto& e : entries ) {
+      if( e.second.contains( "action" ) ) {
+         create_funded_account( e.second["authorizer"].as<account_name>(), funding );
+      }
+   }
+   produce_block();
+
+   std::map<std::string, replay_stats> by_action;
+   std::vector<replayed_action>        replayed;
+   std::vector<fc::variant>            failures;
+   uint32_t in_block = 0;
+
+   const auto start = std::chrono::steady_clock::now();
+   for( const auto& e : entries ) {
+      const auto& entry = e.second;
+      if( entry.contains( "skip_seconds" ) ) {
+         produce_block( fc::seconds( entry["skip_seconds"].as_int64() ) );
+         in_block = 0;
+         continue;
+      }
+      if( !entry.contains( "action" ) ) {
+         continue;
+      }
+
+      const std::string  action     = entry["action"].as_string();
+      const account_name authorizer = entry["authorizer"].as<account_name>();
+      const account_name contract   = entry.contains( "contract" ) ? entry["contract"].as<account_name>() : config::system_account_name;
+      auto& stats = by_action[action];
+      try {
+         auto trace = base_tester::push_action( contract, action_name( string_to_name( action.c_str() ) ), authorizer,
+                                                  entry["data"].get_object() );
+         ++stats.count;
+         stats.elapsed_total_us += trace->elapsed.count();
+         stats.cpu_total_us     += trace->receipt->cpu_usage_us;
+         stats.cpu_max_us        = std::max( stats.cpu_max_us, trace->receipt->cpu_usage_us );
+         stats.dispatched       += enu_system_tester::count_action_traces( trace->action_traces );
+         replayed.push_back( { e.first, action, authorizer, trace->elapsed.count(), trace->receipt->cpu_usage_us } );
+      } catch( const fc::exception& ex ) {
+         ++stats.failed;
+         failures.push_back( mvo()("line", e.first)("action", action)("error", ex.top_message()) );
+      }
+
+      if( ++in_block >= block_size ) {
+         produce_block();
+         in_block = 0;
+      }
+   }
+   produce_block();
+   const auto wall_us = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+   std::sort( replayed.begin(), replayed.end(), []( const auto& a, const auto& b ) { return a.elapsed_us > b.elapsed_us; } );
+   fc::variants slowest_actions;
+   for( size_t i = 0; i < std::min<size_t>( slowest, replayed.size() ); ++i ) {
+      const auto& r = replayed[i];
+      slowest_actions.push_back( mvo()("line", r.line)("action", r.action)("authorizer", r.authorizer)
+                                      ("elapsed_us", r.elapsed_us)("cpu_us", r.cpu_usage_us) );
+   }
+   mvo actions;
+   for( const auto& a : by_action ) {
+      actions( a.first, a.second.to_variant() );
+   }
+
+   write_json_report( mvo()
+      ("log", log_path)
+      ("actions", replayed.size())
+      ("failed", failures.size())
+      ("wall_time_us", wall_us)
+      ("actions_per_second", wall_us > 0 ? double(replayed.size()) * 1e6 / wall_us : 0.0)
+      ("by_action", actions)
+      ("slowest", slowest_actions)
+      ("failures", failures)
+   );
+
+   // recorded traffic contains failed actions too, the bundled sample does not
+   BOOST_REQUIRE_MESSAGE( allow_failures || failures.empty(), failures.size() << " actions failed, pass --allow_failures=1 to accept them" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()